@@ -34,10 +34,46 @@ void cache_mng_retrieve_file_buf (CacheMng *cmng, fuse_ino_t ino, size_t size, o
 typedef void (*cache_mng_on_store_file_buf_cb) (gboolean success, void *ctx);
 void cache_mng_store_file_buf (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off, unsigned char *buf,
         cache_mng_on_store_file_buf_cb on_store_file_buf_cb, void *ctx);
+// the same, but the data is moved out of "evbuf" instead of being copied
+void cache_mng_store_file_evbuf (CacheMng *cmng, fuse_ino_t ino, off_t off, struct evbuffer *evbuf,
+        cache_mng_on_store_file_buf_cb on_store_file_buf_cb, void *ctx);
+
+// lets the caller read the range directly from the cache file, without copying it to a buffer.
+// Returns FALSE if the range is not on the disk, the file is not opened yet or the range belongs to the memory tier.
+// Otherwise "on_read_file_fd_cb" is called in a worker thread with the descriptor of the cache file,
+// the descriptor and the data of the range are valid until the callback returns.
+// If the read can't be started, the callback is called in the event loop thread with "fd" set to -1
+typedef void (*cache_mng_on_read_file_fd_cb) (void *ctx, int fd, off_t off, size_t size);
+gboolean cache_mng_read_file_fd (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off,
+    cache_mng_on_read_file_fd_cb on_read_file_fd_cb, void *ctx);
+
+// returns TRUE if the whole range is stored in the local storage
+gboolean cache_mng_has_range (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off);
+
+// calls "on_missing_cb" for each part of the range which is not stored in the local storage
+typedef void (*cache_mng_on_missing_cb) (guint64 start, guint64 end, void *ctx);
+void cache_mng_foreach_missing (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off,
+    cache_mng_on_missing_cb on_missing_cb, void *ctx);
+
+// registry of ranges which are being downloaded, used to share a single request between several readers
+// marks range as being downloaded
+void cache_mng_pending_add (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off);
+// returns TRUE if the whole range is being downloaded
+gboolean cache_mng_pending_exists (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off);
+// returns TRUE if the whole range is being downloaded, "on_pending_done_cb" is called once download is finished
+typedef void (*cache_mng_on_pending_done_cb) (gboolean success, void *ctx);
+gboolean cache_mng_pending_wait (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off,
+    cache_mng_on_pending_done_cb on_pending_done_cb, void *ctx);
+// download is finished, notifies all waiters
+void cache_mng_pending_done (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off, gboolean success);
 
 // removes file from local storage
 void cache_mng_remove_file (CacheMng *cmng, fuse_ino_t ino);
 
+// sets object path of the file, used by the persistent cache to find data stored by the previous mounts
+// "is_new" is TRUE if the file is created or overwritten
+void cache_mng_set_file_path (CacheMng *cmng, fuse_ino_t ino, const gchar *fname, gboolean is_new);
+
 // get current size of cache
 guint64 cache_mng_size (CacheMng *cmng);
 
@@ -49,4 +85,6 @@ const char *cache_mng_get_etag(CacheMng *cmng, fuse_ino_t ino);
 gboolean cache_mng_update_etag(CacheMng *cmng, fuse_ino_t ino, const char *etag);
 
 void cache_mng_get_stats (CacheMng *cmng, guint32 *entries_num, guint64 *total_size, guint64 *cache_hits, guint64 *cache_miss);
+// name of block replacement policy, number of new blocks which were recently evicted (ghost hits) and the rest of new blocks
+void cache_mng_get_policy_stats (CacheMng *cmng, const gchar **policy, guint64 *ghost_hits, guint64 *ghost_miss);
 #endif
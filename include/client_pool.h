@@ -40,12 +40,40 @@ ClientPool *client_pool_create (Application *app,
 
 void client_pool_destroy (ClientPool *pool);
 
+// lets the pool grow from "client_count" up to "max_clients" clients while all of them are busy
+// and the average request time is not rising (see client_pool_on_request_feedback ()),
+// clients above "client_count" are destroyed after "idle_timeout" seconds of inactivity
+void client_pool_set_max_clients (ClientPool *pool, gint max_clients, guint idle_timeout);
+
+// priority classes of awaiting requests, in order of importance
+typedef enum {
+    CLIENT_POOL_PRIO_METADATA = 0, // lookups, getattr and directory listings
+    CLIENT_POOL_PRIO_READ = 1, // data requested by the application
+    CLIENT_POOL_PRIO_READAHEAD = 2, // readahead and prefetch
+    CLIENT_POOL_PRIO_WRITEBACK = 3, // uploads
+    CLIENT_POOL_PRIO_COUNT
+} ClientPoolPriority;
+
 // add client's callback to the awaiting queue
 // return TRUE if added, FALSE if list is full
 typedef void (*ClientPool_on_client_ready) (gpointer client, gpointer ctx);
 gboolean client_pool_get_client (ClientPool *pool, ClientPool_on_client_ready on_client_ready, gpointer ctx);
+// the same as client_pool_get_client (), but queues the request with the given priority,
+// background (readahead and writeback) requests are rejected first when the queue fills up
+gboolean client_pool_get_client_prio (ClientPool *pool, ClientPoolPriority prio,
+    ClientPool_on_client_ready on_client_ready, gpointer ctx);
+// sets the priority of requests made with client_pool_get_client ()
+void client_pool_set_default_prio (ClientPool *pool, ClientPoolPriority prio);
+// lets foreground (metadata and read) requests of "pool" use idle clients of "lender"
+// when all clients of "pool" are busy
+void client_pool_add_lender (ClientPool *pool, ClientPool *lender);
 gint client_pool_get_client_count (ClientPool *pool);
 
+// called by a client when a response is received, "ctx" is the one passed to ClientPool_client_set_on_released_cb,
+// "congested" is TRUE if the server throttled the request (503 SlowDown) or it timed out,
+// "latency_ms" is the time the request took, it is ignored for congested requests
+void client_pool_on_request_feedback (gpointer ctx, gboolean congested, guint64 latency_ms);
+
 typedef void (*ClientPool_on_request_done) (gpointer callback_data, gboolean success);
 void client_pool_add_request (ClientPool *pool,
     ClientPool_on_request_done on_request_done, gpointer callback_data);
@@ -30,8 +30,9 @@ typedef struct _DirEntry DirEntry;
 DirTree *dir_tree_create (Application *app);
 void dir_tree_destroy (DirTree *dtree);
 
+// "etag" is NULL if it's unknown
 DirEntry *dir_tree_update_entry (DirTree *dtree, const gchar *path, DirEntryType type,
-    fuse_ino_t parent_ino, const gchar *entry_name, long long size, time_t last_modified);
+    fuse_ino_t parent_ino, const gchar *entry_name, long long size, time_t last_modified, const gchar *etag);
 
 // mark that DirTree is being updated
 
@@ -65,9 +66,12 @@ void dir_tree_setattr (DirTree *dtree, fuse_ino_t ino,
 
 
 typedef void (*DirTree_file_read_cb) (fuse_req_t req, gboolean success, const char *buf, size_t buf_size);
+// optional, cached data is read directly from "fd" at "off",
+// called in a worker thread, "fd" is valid only during the call, -1 on error
+typedef void (*DirTree_file_read_fd_cb) (fuse_req_t req, int fd, off_t off, size_t size);
 void dir_tree_file_read (DirTree *dtree, fuse_ino_t ino,
     size_t size, off_t off,
-    DirTree_file_read_cb getattr_cb, fuse_req_t req,
+    DirTree_file_read_cb getattr_cb, DirTree_file_read_fd_cb file_read_fd_cb, fuse_req_t req,
     struct fuse_file_info *fi);
 
 typedef void (*DirTree_file_create_cb) (fuse_req_t req, gboolean success, fuse_ino_t ino, int mode, off_t file_size, struct fuse_file_info *fi);
@@ -111,6 +115,12 @@ guint dir_tree_get_inode_count (DirTree *dtree);
 
 void dir_tree_set_entry_exist (DirTree *dtree, fuse_ino_t ino);
 
+// returns TRUE if size and ETag (without quotes) of the file were received from the listing
+// within "filesystem.file_meta_max_time" seconds and the file is not modified locally
+gboolean dir_tree_get_entry_meta (DirTree *dtree, fuse_ino_t ino, guint64 *size, const gchar **etag);
+// size and ETag (with or without quotes) of the file are received from the server
+void dir_tree_set_entry_meta (DirTree *dtree, fuse_ino_t ino, guint64 size, const gchar *etag);
+
 
 typedef void (*DirTree_symlink_cb) (fuse_req_t req, gboolean success, fuse_ino_t ino, int mode, off_t file_size, time_t ctime);
 void dir_tree_create_symlink (DirTree *dtree, fuse_ino_t parent_ino, const char *fname, const char *link,
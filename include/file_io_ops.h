@@ -33,9 +33,17 @@ void fileio_write_buffer (FileIO *fop,
     FileIO_on_buffer_written_cb on_buffer_written_cb, gpointer ctx);
 
 typedef void (*FileIO_on_buffer_read_cb) (gpointer ctx, gboolean success, char *buf, size_t size);
+// cached data can be read directly from "fd" at "off", see cache_mng_read_file_fd ():
+// called in a worker thread, "fd" and the data are valid only during the call, "fd" is -1 on error
+typedef void (*FileIO_on_fd_read_cb) (gpointer ctx, int fd, off_t off, size_t size);
+// "on_fd_read_cb" is optional, if set it's used instead of "on_buffer_read_cb" when data is in the local cache
 void fileio_read_buffer (FileIO *fop,
     size_t size, off_t off, fuse_ino_t ino,
-    FileIO_on_buffer_read_cb on_buffer_read_cb, gpointer ctx);
+    FileIO_on_buffer_read_cb on_buffer_read_cb, FileIO_on_fd_read_cb on_fd_read_cb, gpointer ctx);
+
+// starts downloading the whole object of "size" bytes into the cache,
+// the first read uses response headers instead of HEAD request
+void fileio_prefetch (FileIO *fop, guint64 size);
 
 typedef void (*FileIO_simple_on_upload_cb) (gpointer ctx, gboolean success);
 void fileio_simple_upload (Application *app, const gchar *fname, const char *str, mode_t mode,
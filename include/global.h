@@ -62,8 +62,11 @@
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/uio.h>
 #include <inttypes.h>
 #include <fcntl.h>
+#include <sys/file.h>
 #include <math.h>
 #include <ftw.h>
 //#include <sys/xattr.h>
@@ -120,6 +123,7 @@ typedef struct _ClientPool ClientPool;
 typedef struct _ConfData ConfData;
 typedef struct _CacheMng CacheMng;
 typedef struct _StatSrv StatSrv;
+typedef struct _WorkerPool WorkerPool;
 
 struct event_base *application_get_evbase (Application *app);
 struct evdns_base *application_get_dnsbase (Application *app);
@@ -131,6 +135,7 @@ ClientPool *application_get_ops_client_pool (Application *app);
 DirTree *application_get_dir_tree (Application *app);
 CacheMng *application_get_cache_mng (Application *app);
 StatSrv *application_get_stat_srv (Application *app);
+WorkerPool *application_get_worker_pool (Application *app);
 RFuse *application_get_rfuse (Application *app);
 
 #ifdef SSL_ENABLED
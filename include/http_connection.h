@@ -25,6 +25,11 @@ typedef enum {
     RT_list = 0,
 } RequestType;
 
+// body of a successful response is passed in chunks as it arrives, "off" is the offset of the chunk in the body.
+// The data may be moved out of "chunk", otherwise it is discarded after the call
+typedef void (*HttpConnection_on_chunk_cb) (HttpConnection *con, gpointer ctx, struct evkeyvalq *headers,
+    struct evbuffer *chunk, guint64 off);
+
 struct _HttpConnection {
     Application *app;
 
@@ -36,6 +41,7 @@ struct _HttpConnection {
     // is taken by high level
     gboolean is_acquired;
     GList *l_output_headers;
+    HttpConnection_on_chunk_cb chunk_cb; // used by the next request
 
     // statistics info
     enum evhttp_cmd_type cur_cmd_type;
@@ -55,6 +61,10 @@ void http_connection_destroy (gpointer data);
 
 void http_connection_add_output_header (HttpConnection *con, const gchar *key, const gchar *value);
 
+// the next request streams the response body to "chunk_cb",
+// response_cb is called with NULL buffer and the total length of the body
+void http_connection_set_on_chunk_cb (HttpConnection *con, HttpConnection_on_chunk_cb chunk_cb);
+
 void http_connection_set_on_released_cb (gpointer client, ClientPool_on_released_cb client_on_released_cb, gpointer ctx);
 gboolean http_connection_check_rediness (gpointer client);
 gboolean http_connection_acquire (HttpConnection *con);
@@ -91,4 +101,8 @@ gboolean http_connection_make_request (HttpConnection *con,
     HttpConnection_response_cb response_cb,
     gpointer ctx);
 
+// returns a random delay (msec) before the retry number "retry_id",
+// the upper bound doubles with each retry starting from "base_ms" and never exceeds "max_ms"
+guint64 http_connection_get_retry_delay (guint64 base_ms, guint64 max_ms, gint retry_id);
+
 #endif
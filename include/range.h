@@ -27,10 +27,18 @@ Range *range_create ();
 void range_destroy (Range *range);
 
 void range_add (Range *range, guint64 start, guint64 end);
+// removes [start, end) from the range, intervals are trimmed or split
+void range_remove (Range *range, guint64 start, guint64 end);
 
 gboolean range_contain (Range *range, guint64 start, guint64 end);
 gint range_count (Range *range);
 guint64 range_length (Range *range);
 void range_print (Range *range);
 
+// calls "foreach_cb" for each interval in ascending order
+typedef void (*Range_foreach_cb) (guint64 start, guint64 end, gpointer ctx);
+void range_foreach (Range *range, Range_foreach_cb foreach_cb, gpointer ctx);
+// calls "foreach_cb" for each part of [start, end) which is not in the range
+void range_foreach_missing (Range *range, guint64 start, guint64 end, Range_foreach_cb foreach_cb, gpointer ctx);
+
 #endif
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2012-2014 Paul Ionkin <paul.ionkin@gmail.com>
+ * Copyright (C) 2012-2014 Skoobe GmbH. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef _WORKER_POOL_H_
+#define _WORKER_POOL_H_
+
+#include "global.h"
+
+// runs CPU or disk bound tasks in a pool of threads,
+// completion callbacks are executed in the event loop thread
+
+// executed in a worker thread, must not touch any event loop objects
+typedef void (*WorkerPool_task_cb) (gpointer ctx);
+// executed in the event loop thread once the task is finished
+typedef void (*WorkerPool_on_task_done_cb) (gpointer ctx);
+
+WorkerPool *worker_pool_create (Application *app, gint thread_count);
+void worker_pool_destroy (WorkerPool *wpool);
+
+// returns FALSE if task can't be queued
+gboolean worker_pool_push (WorkerPool *wpool,
+    WorkerPool_task_cb task_cb, WorkerPool_on_task_done_cb on_task_done_cb, gpointer ctx);
+#endif
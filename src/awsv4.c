@@ -44,17 +44,13 @@ gchar* sha256_base16(const char* str, unsigned int length)
 { 
     unsigned char *hashOut; 
     gchar* _result;
-    char* _buffer;
 
     hashOut = (unsigned char *)malloc((SHA256_DIGEST_LENGTH)* sizeof(unsigned char));
 
-    _buffer = g_malloc(sizeof(char)*(length));
-    memcpy(_buffer, str, length);
-
-    sha256(_buffer, length, hashOut);
+    // hash the input in place, parts can be several megabytes large
+    sha256(str, length, hashOut);
     _result = HexEncode(hashOut, SHA256_DIGEST_LENGTH);
         
-    g_free(_buffer);
     g_free(hashOut);
 
     return _result;
@@ -389,51 +385,88 @@ gchar *utc_yyyymmdd(const time_t  *t)
 // -----------------------------------------------------------------------------------
 // TASK 3
 // http://docs.aws.amazon.com/general/latest/gr/sigv4-calculate-signature.html
-gchar *calculate_signature(
-                            const time_t *request_date, 
+
+// the signing key depends only on the secret, the UTC day, region and service,
+// so it's derived once a day instead of for every request,
+// requests are signed in the event loop thread only
+typedef struct {
+    gchar date[9];
+    unsigned char secret_hash[SHA256_DIGEST_LENGTH]; // the secret itself is not kept
+    gchar *region;
+    gchar *service;
+    unsigned char key[SHA256_DIGEST_LENGTH];
+} SigningKeyCache;
+
+static SigningKeyCache signing_key_cache;
+
+// derives kSigning = HMAC(HMAC(HMAC(HMAC("AWS4" + secret, date), region), service), "aws4_request")
+static void derive_signing_key(
+                            const gchar *date,
                             const gchar* secret,
                             const gchar* region,
                             const gchar* service,
-                            const gchar* string_to_sign) 
+                            unsigned char *kSigning)
 {
-    unsigned char* kDate;
-    unsigned char *kRegion;
-    unsigned char *kService;
-    unsigned char *kSigning;
-    unsigned char *kSig;
-
-    gchar*  c_yyyymmdd;
-    const gchar*  c_aws4_request;
+    unsigned char kDate[SHA256_DIGEST_LENGTH];
+    unsigned char kRegion[SHA256_DIGEST_LENGTH];
+    unsigned char kService[SHA256_DIGEST_LENGTH];
+    unsigned int k_len = SHA256_DIGEST_LENGTH;
     gchar* k1;
 
-    gchar* _result;
-
-    c_yyyymmdd = utc_yyyymmdd(request_date);
-    c_aws4_request = "aws4_request";
     k1 = g_strconcat(AWS4, secret, NULL);
 
+    HMAC(EVP_sha256(), k1, strlen(k1),
+                    (unsigned char*)date, strlen(date), kDate, &k_len);
 
-    kDate = HMAC(EVP_sha256(), k1, strlen(k1), 
-                    (unsigned char*)c_yyyymmdd, strlen(c_yyyymmdd), NULL, NULL); 
+    HMAC(EVP_sha256(), kDate, SHA256_DIGEST_LENGTH,
+                    (unsigned char*)region, strlen(region), kRegion, &k_len);
 
-    kRegion = HMAC(EVP_sha256(), kDate, SHA256_DIGEST_LENGTH, 
-                    (unsigned char*)region, strlen(region), NULL, NULL); 
+    HMAC(EVP_sha256(), kRegion, SHA256_DIGEST_LENGTH,
+                    (unsigned char*)service, strlen(service), kService, &k_len);
 
-    kService = HMAC(EVP_sha256(), kRegion, SHA256_DIGEST_LENGTH, 
-                    (unsigned char*)service, strlen(service), NULL, NULL); 
-    
-    kSigning = HMAC(EVP_sha256(), kService, SHA256_DIGEST_LENGTH, 
-                    (unsigned char*)c_aws4_request, strlen(c_aws4_request), NULL, NULL); 
-
-    kSig = HMAC(EVP_sha256(), kSigning, SHA256_DIGEST_LENGTH, 
-                    (unsigned char*)string_to_sign, strlen(string_to_sign), NULL, NULL); 
-    
-    _result = HexEncode(kSig, SHA256_DIGEST_LENGTH);
+    HMAC(EVP_sha256(), kService, SHA256_DIGEST_LENGTH,
+                    (unsigned char*)AWS4_REQUEST, strlen(AWS4_REQUEST), kSigning, &k_len);
 
-    g_free(c_yyyymmdd);
+    memset(k1, 0, strlen(k1));
     g_free(k1);
-    
-    return _result;
+}
+
+gchar *calculate_signature(
+                            const time_t *request_date, 
+                            const gchar* secret,
+                            const gchar* region,
+                            const gchar* service,
+                            const gchar* string_to_sign) 
+{
+    gchar c_yyyymmdd[9];
+    struct tm tm;
+    unsigned char kSig[SHA256_DIGEST_LENGTH];
+    unsigned int kSig_len = SHA256_DIGEST_LENGTH;
+    unsigned char secret_hash[SHA256_DIGEST_LENGTH];
+    SigningKeyCache *cache = &signing_key_cache;
+
+    strftime(c_yyyymmdd, sizeof(c_yyyymmdd), "%Y%m%d", gmtime_r(request_date, &tm));
+    sha256(secret, strlen(secret), secret_hash);
+
+    if(strcmp(cache->date, c_yyyymmdd) != 0 ||
+        memcmp(cache->secret_hash, secret_hash, SHA256_DIGEST_LENGTH) != 0 ||
+        g_strcmp0(cache->region, region) != 0 ||
+        g_strcmp0(cache->service, service) != 0)
+    {
+        derive_signing_key(c_yyyymmdd, secret, region, service, cache->key);
+
+        strcpy(cache->date, c_yyyymmdd);
+        memcpy(cache->secret_hash, secret_hash, SHA256_DIGEST_LENGTH);
+        g_free(cache->region);
+        cache->region = g_strdup(region);
+        g_free(cache->service);
+        cache->service = g_strdup(service);
+    }
+
+    HMAC(EVP_sha256(), cache->key, SHA256_DIGEST_LENGTH,
+                    (unsigned char*)string_to_sign, strlen(string_to_sign), kSig, &kSig_len);
+
+    return HexEncode(kSig, SHA256_DIGEST_LENGTH);
 }
 
 
@@ -19,47 +19,378 @@
 #include "range.h"
 #include "utils.h"
 #include "conf.h"
+#include "worker_pool.h"
 
 /*{{{ structs / func defs */
 
 struct _CacheMng {
     Application *app;
     GHashTable *h_entries;
-    GQueue *q_lru;
+    const struct _CachePolicy *policy; // replacement policy of cached blocks
+    GQueue *q_blocks; // _CacheBlock, most recently used (LRU) or inserted (S3-FIFO main queue) first
+    GQueue *q_blocks_small; // S3-FIFO small queue, blocks which are accessed only once so far
+    struct _CacheGhostList *ghosts; // S3-FIFO, recently evicted blocks
+    guint64 block_size;
+    GHashTable *h_pending; // ino -> GList of _CachePending
+    GQueue *q_open; // entries with opened file descriptor, most recently used first
+    gboolean persistent; // keep cached data between mounts
+    GHashTable *h_fnames; // ino -> object path, persistent mode only
+    int lock_fd; // locked file in the persistent cache folder, -1 if not persistent
+    GHashTable *h_index; // object path -> _CacheIndexRecord, loaded entries which are not opened yet
     guint64 size;
     guint64 max_size;
     gchar *cache_dir;
-    time_t check_time; // last check time of stored objects
+
+    // eviction
+    guint high_watermark; // background eviction starts above this share of capacity, in percents
+    guint low_watermark; // ... and stops below this one
+    guint64 min_free_size; // free space to keep on the cache filesystem
+    guint64 disk_limit; // cache size which leaves "min_free_size" free on the disk
+    time_t statvfs_time; // last check time of the free space
+    struct event *ev_evict;
+    struct event *ev_check; // periodic check of the cache size against free disk space
+
+    // memory tier
+    GQueue *q_mem_blocks; // LRU list of _CacheMemBlock, most recently used first
+    guint64 mem_size;
+    guint64 mem_max_size;
+    struct _CacheGhostList *mem_ghosts; // chunks which were read from the disk recently
 
     // stats
     guint64 cache_hits;
     guint64 cache_miss;
+    guint64 ghost_hits; // blocks which are stored again shortly after eviction
+    guint64 ghost_miss;
 };
 
 struct _CacheEntry {
+    CacheMng *cmng;
     fuse_ino_t ino;
     Range *avail_range;
     time_t modification_time;
+    GHashTable *h_blocks; // block index -> _CacheBlock
+    GHashTable *h_mem_blocks; // memory block index -> _CacheMemBlock
+    guint64 write_seq; // increased by every modification of the cached data
+    gchar *etag;
+    gchar *fname; // object path, NULL if the entry is not persistent
+
+    gchar *path;
+    int fd; // opened by the first disk operation, -1 if not opened
+    GList *ll_open;
+    GQueue *q_io; // disk operations of this entry, the head one is running
+    gboolean removed; // entry is removed, but disk operations are not finished yet
+    gboolean pinned; // data is being added, the entry is kept even if all its blocks are evicted
+};
+
+// cached part of the file, unit of eviction
+struct _CacheBlock {
+    struct _CacheEntry *entry;
+    guint64 idx;
+    GQueue *queue; // policy queue which holds the block
+    GList *ll_lru;
+    guint freq; // S3-FIFO, number of accesses since the block is inserted or reinserted
+};
+
+// block replacement policy
+struct _CachePolicy {
+    const gchar *name;
+    // block is read or written, "is_new" is TRUE if the block is just added
+    void (*access) (CacheMng *cmng, struct _CacheBlock *block, gboolean is_new);
+    // returns the next block to evict, NULL if the cache is empty
+    struct _CacheBlock *(*victim) (CacheMng *cmng);
+};
+
+// copy of the hot part of the file, served without disk I/O
+struct _CacheMemBlock {
+    struct _CacheEntry *entry; // NULL if the block is removed from the memory tier
+    guint64 idx;
+    guint64 len; // data starts at the beginning of the block
+    unsigned char *data;
+    gint ref;
     GList *ll_lru;
+};
+
+// block which is not cached, but remembered by its position
+struct _CacheGhost {
+    fuse_ino_t ino;
+    guint64 idx;
+    GList *ll;
+};
+
+// bounded list of ghosts, the oldest one is forgotten first
+struct _CacheGhostList {
+    GHashTable *h_ghosts; // _CacheGhost -> _CacheGhost
+    GQueue *q_ghosts; // most recently added first
+    guint max_len;
+};
+
+typedef enum {
+    CIO_read = 0,
+    CIO_write = 1,
+    CIO_punch = 2, // deallocate evicted block
+    CIO_read_fd = 3, // the caller reads from the file descriptor
+} CacheIOType;
+
+// entry loaded from the index of the persistent cache
+struct _CacheIndexRecord {
+    gchar *fname;
     gchar *etag;
+    Range *range;
+    gchar *path;
+};
+
+struct _CachePending {
+    guint64 start;
+    guint64 end;
+    GList *l_waiters; // list of _CacheWaiter
+};
+
+struct _CacheWaiter {
+    cache_mng_on_pending_done_cb on_pending_done_cb;
+    void *ctx;
 };
 
 struct _CacheContext {
+    struct _CacheEntry *entry;
+    CacheIOType type;
+    gboolean skip; // do not touch the disk, operation is failed
+    guint64 write_seq; // entry write_seq at the time of submission
+    struct _CacheMemBlock *mem_block; // "buf" points to the data of memory block
+    off_t off;
     guint64 size;
     unsigned char *buf;
+    struct evbuffer *evbuf; // CIO_write: data to write instead of "buf", NULL if not used
     gboolean success;
     union {
         cache_mng_on_retrieve_file_buf_cb retrieve_cb;
         cache_mng_on_store_file_buf_cb store_cb;
+        cache_mng_on_read_file_fd_cb read_fd_cb;
     } cb;
     void *user_ctx;
     struct event *ev;
 };
 
 #define CMNG_LOG "cmng"
+// keep at most this number of cache files opened
+#define CMNG_MAX_OPEN_FILES 128
+// maximum number of evbuffer segments written by a single call
+#define CMNG_WRITE_IOV 64
+// small sequential writes which are waiting for the disk are merged up to this size, 1Mb
+#define CMNG_COALESCE_MAX_SIZE (1024 * 1024)
+// default size of cache block, 4Mb
+#define CMNG_DEFAULT_BLOCK_SIZE (4 * 1024 * 1024)
+// size of memory tier block, 64Kb
+#define CMNG_MEM_BLOCK_SIZE (64 * 1024)
+// default size of memory tier, 32Mb
+#define CMNG_DEFAULT_MEM_SIZE (32 * 1024 * 1024)
+// number of recently read chunks which are remembered as candidates for the memory tier
+#define CMNG_MEM_GHOSTS 4096
+// default watermarks of background eviction, in percents of the cache capacity
+#define CMNG_DEFAULT_HIGH_WATERMARK 95
+#define CMNG_DEFAULT_LOW_WATERMARK 85
+// background eviction: maximum number of blocks evicted by a single run
+#define CMNG_EVICT_BATCH 64
+// default interval of free space checks, in seconds
+#define CMNG_DEFAULT_CHECK_INTERVAL 10
+// S3-FIFO: share of small queue, in percents of cached blocks
+#define CMNG_S3FIFO_SMALL_PERCENT 10
+// S3-FIFO: maximum value of block access counter
+#define CMNG_S3FIFO_MAX_FREQ 3
+// name of the file which is locked by the mount using the persistent cache
+#define CMNG_LOCK_NAME "lock"
 
 static void cache_entry_destroy (gpointer data);
+static void cache_mem_drop_range (CacheMng *cmng, struct _CacheEntry *entry, guint64 start, guint64 end);
+static struct _CacheGhostList *cache_ghost_list_create (guint max_len);
+static void cache_ghost_list_destroy (struct _CacheGhostList *ghosts);
+static const struct _CachePolicy *cache_policy_find (const gchar *name);
+static void cache_mng_on_evict_cb (evutil_socket_t fd, short flags, void *ctx);
+static void cache_mng_on_check_cb (evutil_socket_t fd, short flags, void *ctx);
+static void cache_index_record_destroy (gpointer data);
+static gboolean cache_mng_index_lock (CacheMng *cmng, const gchar *cache_dir);
+static void cache_mng_index_load (CacheMng *cmng);
+static void cache_mng_index_save (CacheMng *cmng);
+static void cache_mng_index_remove (CacheMng *cmng, const gchar *fname);
+static void cache_pending_list_destroy (gpointer data);
 static void cache_mng_rm_cache_dir (CacheMng *cmng);
+static int cache_mng_file_name (CacheMng *cmng, char *buf, int buflen, fuse_ino_t ino);
+/*}}}*/
+
+/*{{{ ghost list */
+static guint cache_ghost_hash (gconstpointer key)
+{
+    const struct _CacheGhost *ghost = (const struct _CacheGhost *) key;
+
+    return g_int64_hash (&ghost->idx) ^ g_direct_hash (GUINT_TO_POINTER (ghost->ino));
+}
+
+static gboolean cache_ghost_equal (gconstpointer a, gconstpointer b)
+{
+    const struct _CacheGhost *ghost_a = (const struct _CacheGhost *) a;
+    const struct _CacheGhost *ghost_b = (const struct _CacheGhost *) b;
+
+    return ghost_a->ino == ghost_b->ino && ghost_a->idx == ghost_b->idx;
+}
+
+static struct _CacheGhostList *cache_ghost_list_create (guint max_len)
+{
+    struct _CacheGhostList *ghosts;
+
+    ghosts = g_new0 (struct _CacheGhostList, 1);
+    ghosts->h_ghosts = g_hash_table_new_full (cache_ghost_hash, cache_ghost_equal, g_free, NULL);
+    ghosts->q_ghosts = g_queue_new ();
+    ghosts->max_len = max_len;
+
+    return ghosts;
+}
+
+static void cache_ghost_list_destroy (struct _CacheGhostList *ghosts)
+{
+    g_queue_free (ghosts->q_ghosts);
+    g_hash_table_destroy (ghosts->h_ghosts);
+    g_free (ghosts);
+}
+
+// returns TRUE if the block is remembered, the block is forgotten
+static gboolean cache_ghost_list_remove (struct _CacheGhostList *ghosts, fuse_ino_t ino, guint64 idx)
+{
+    struct _CacheGhost key, *ghost;
+
+    key.ino = ino;
+    key.idx = idx;
+    ghost = g_hash_table_lookup (ghosts->h_ghosts, &key);
+    if (!ghost)
+        return FALSE;
+
+    g_queue_delete_link (ghosts->q_ghosts, ghost->ll);
+    g_hash_table_remove (ghosts->h_ghosts, ghost);
+
+    return TRUE;
+}
+
+static gboolean cache_ghost_list_contains (struct _CacheGhostList *ghosts, fuse_ino_t ino, guint64 idx)
+{
+    struct _CacheGhost key;
+
+    key.ino = ino;
+    key.idx = idx;
+
+    return g_hash_table_lookup (ghosts->h_ghosts, &key) != NULL;
+}
+
+static void cache_ghost_list_add (struct _CacheGhostList *ghosts, fuse_ino_t ino, guint64 idx)
+{
+    struct _CacheGhost *ghost;
+
+    cache_ghost_list_remove (ghosts, ino, idx);
+
+    ghost = g_new0 (struct _CacheGhost, 1);
+    ghost->ino = ino;
+    ghost->idx = idx;
+    g_queue_push_head (ghosts->q_ghosts, ghost);
+    ghost->ll = g_queue_peek_head_link (ghosts->q_ghosts);
+    g_hash_table_insert (ghosts->h_ghosts, ghost, ghost);
+
+    // forget the oldest one
+    if (g_queue_get_length (ghosts->q_ghosts) > ghosts->max_len)
+        g_hash_table_remove (ghosts->h_ghosts, g_queue_pop_tail (ghosts->q_ghosts));
+}
+/*}}}*/
+
+/*{{{ eviction policy */
+static void cache_block_move (struct _CacheBlock *block, GQueue *queue)
+{
+    g_queue_unlink (block->queue, block->ll_lru);
+    g_queue_push_head_link (queue, block->ll_lru);
+    block->queue = queue;
+}
+
+static void cache_block_insert (struct _CacheBlock *block, GQueue *queue)
+{
+    g_queue_push_head (queue, block);
+    block->ll_lru = g_queue_peek_head_link (queue);
+    block->queue = queue;
+}
+
+// LRU: single queue, accessed blocks are moved to the front
+static void cache_lru_access (CacheMng *cmng, struct _CacheBlock *block, gboolean is_new)
+{
+    if (is_new)
+        cache_block_insert (block, cmng->q_blocks);
+    else
+        cache_block_move (block, cmng->q_blocks);
+}
+
+static struct _CacheBlock *cache_lru_victim (CacheMng *cmng)
+{
+    return (struct _CacheBlock *) g_queue_peek_tail (cmng->q_blocks);
+}
+
+// S3-FIFO: new blocks go to the small queue, only blocks which are accessed again there
+// get to the main queue, so a single scan does not flush the working set
+static void cache_s3fifo_access (CacheMng *cmng, struct _CacheBlock *block, gboolean is_new)
+{
+    if (!is_new) {
+        block->freq = MIN (block->freq + 1, CMNG_S3FIFO_MAX_FREQ);
+        return;
+    }
+
+    block->freq = 0;
+    // the block was evicted too early
+    if (cache_ghost_list_remove (cmng->ghosts, block->entry->ino, block->idx)) {
+        cmng->ghost_hits++;
+        cache_block_insert (block, cmng->q_blocks);
+    } else {
+        cmng->ghost_miss++;
+        cache_block_insert (block, cmng->q_blocks_small);
+    }
+}
+
+static struct _CacheBlock *cache_s3fifo_victim (CacheMng *cmng)
+{
+    struct _CacheBlock *block;
+
+    for (;;) {
+        guint small_len = g_queue_get_length (cmng->q_blocks_small);
+        guint main_len = g_queue_get_length (cmng->q_blocks);
+
+        if (!small_len && !main_len)
+            return NULL;
+
+        if (small_len && (!main_len || small_len * 100 >= (small_len + main_len) * CMNG_S3FIFO_SMALL_PERCENT)) {
+            block = (struct _CacheBlock *) g_queue_peek_tail (cmng->q_blocks_small);
+            if (!block->freq) {
+                cache_ghost_list_add (cmng->ghosts, block->entry->ino, block->idx);
+                return block;
+            }
+            block->freq = 0;
+            cache_block_move (block, cmng->q_blocks);
+        } else {
+            block = (struct _CacheBlock *) g_queue_peek_tail (cmng->q_blocks);
+            if (!block->freq)
+                return block;
+            block->freq--;
+            cache_block_move (block, cmng->q_blocks);
+        }
+    }
+}
+
+static const struct _CachePolicy cache_policies[] = {
+    { "lru", cache_lru_access, cache_lru_victim },
+    { "s3fifo", cache_s3fifo_access, cache_s3fifo_victim },
+};
+
+static const struct _CachePolicy *cache_policy_find (const gchar *name)
+{
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS (cache_policies); i++) {
+        if (!g_ascii_strcasecmp (cache_policies[i].name, name))
+            return &cache_policies[i];
+    }
+
+    return NULL;
+}
 /*}}}*/
 
 /*{{{ create / destroy */
@@ -67,13 +398,20 @@ CacheMng *cache_mng_create (Application *app)
 {
     CacheMng *cmng;
     gchar *rnd_str;
+    struct timeval check_tv = {0, 0};
 
     cmng = g_new0 (CacheMng, 1);
     cmng->app = app;
     cmng->h_entries = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, cache_entry_destroy);
-    cmng->q_lru = g_queue_new ();
+    cmng->q_blocks = g_queue_new ();
+    cmng->q_blocks_small = g_queue_new ();
+    cmng->q_mem_blocks = g_queue_new ();
+    cmng->mem_ghosts = cache_ghost_list_create (CMNG_MEM_GHOSTS);
+    cmng->h_pending = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, cache_pending_list_destroy);
+    cmng->q_open = g_queue_new ();
+    cmng->h_fnames = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+    cmng->h_index = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, cache_index_record_destroy);
     cmng->size = 0;
-    cmng->check_time = time (NULL);
     // If "filesystem.cache_dir_max_megabyte_size" is set, use it, else use "filesystem.cache_dir_max_size"
     if (conf_node_exists (application_get_conf (cmng->app), "filesystem.cache_dir_max_megabyte_size")) {
         cmng->max_size = conf_get_uint (application_get_conf (cmng->app), "filesystem.cache_dir_max_megabyte_size");
@@ -82,64 +420,358 @@ CacheMng *cache_mng_create (Application *app)
         cmng->max_size = conf_get_uint (application_get_conf (cmng->app), "filesystem.cache_dir_max_size");
     }
     LOG_debug (CMNG_LOG, "Maximum cache size (bytes): %"PRId64, cmng->max_size);
-    // generate random folder name for storing cache
-    rnd_str = get_random_string (20, TRUE);
-    cmng->cache_dir = g_strdup_printf ("%s/%s",
-        conf_get_string (application_get_conf (cmng->app), "filesystem.cache_dir"), rnd_str);
-    g_free (rnd_str);
+    cmng->high_watermark = CMNG_DEFAULT_HIGH_WATERMARK;
+    if (conf_node_exists (application_get_conf (cmng->app), "filesystem.cache_high_watermark"))
+        cmng->high_watermark = MIN (conf_get_uint (application_get_conf (cmng->app), "filesystem.cache_high_watermark"), 100);
+    cmng->low_watermark = CMNG_DEFAULT_LOW_WATERMARK;
+    if (conf_node_exists (application_get_conf (cmng->app), "filesystem.cache_low_watermark"))
+        cmng->low_watermark = conf_get_uint (application_get_conf (cmng->app), "filesystem.cache_low_watermark");
+    cmng->low_watermark = MIN (cmng->low_watermark, cmng->high_watermark);
+    cmng->min_free_size = 0;
+    if (conf_node_exists (application_get_conf (cmng->app), "filesystem.cache_dir_min_free_size"))
+        cmng->min_free_size = conf_get_uint (application_get_conf (cmng->app), "filesystem.cache_dir_min_free_size");
+    cmng->disk_limit = G_MAXUINT64;
+    cmng->statvfs_time = 0;
+    cmng->ev_evict = evtimer_new (application_get_evbase (cmng->app), cache_mng_on_evict_cb, cmng);
+    // free space may shrink without any writes to the cache
+    cmng->ev_check = NULL;
+    check_tv.tv_sec = CMNG_DEFAULT_CHECK_INTERVAL;
+    if (conf_node_exists (application_get_conf (cmng->app), "filesystem.cache_check_interval"))
+        check_tv.tv_sec = conf_get_uint (application_get_conf (cmng->app), "filesystem.cache_check_interval");
+    if (check_tv.tv_sec) {
+        cmng->ev_check = event_new (application_get_evbase (cmng->app), -1, EV_PERSIST, cache_mng_on_check_cb, cmng);
+        event_add (cmng->ev_check, &check_tv);
+    }
+    cmng->block_size = CMNG_DEFAULT_BLOCK_SIZE;
+    if (conf_node_exists (application_get_conf (cmng->app), "filesystem.cache_block_size"))
+        cmng->block_size = conf_get_uint (application_get_conf (cmng->app), "filesystem.cache_block_size");
+    if (!cmng->block_size)
+        cmng->block_size = CMNG_DEFAULT_BLOCK_SIZE;
+    cmng->policy = cache_policy_find ("lru");
+    if (conf_node_exists (application_get_conf (cmng->app), "filesystem.cache_eviction_policy")) {
+        const gchar *name = conf_get_string (application_get_conf (cmng->app), "filesystem.cache_eviction_policy");
+
+        cmng->policy = cache_policy_find (name);
+        if (!cmng->policy) {
+            LOG_err (CMNG_LOG, "Unknown cache eviction policy: %s, using LRU", name);
+            cmng->policy = cache_policy_find ("lru");
+        }
+    }
+    // remember as many evicted blocks as the cache can hold
+    cmng->ghosts = cache_ghost_list_create (MAX (cmng->max_size / cmng->block_size, 1));
+    cmng->mem_size = 0;
+    cmng->mem_max_size = CMNG_DEFAULT_MEM_SIZE;
+    if (conf_node_exists (application_get_conf (cmng->app), "filesystem.cache_memory_size"))
+        cmng->mem_max_size = conf_get_uint (application_get_conf (cmng->app), "filesystem.cache_memory_size");
+    cmng->lock_fd = -1;
+    cmng->persistent = conf_node_exists (application_get_conf (cmng->app), "filesystem.cache_persistent") &&
+        conf_get_boolean (application_get_conf (cmng->app), "filesystem.cache_persistent");
+    if (cmng->persistent) {
+        // the same folder is used by every mount
+        cmng->cache_dir = g_strdup_printf ("%s/persistent",
+            conf_get_string (application_get_conf (cmng->app), "filesystem.cache_dir"));
+        // but only by one at a time
+        if (!cache_mng_index_lock (cmng, cmng->cache_dir)) {
+            cmng->persistent = FALSE;
+            g_free (cmng->cache_dir);
+            cmng->cache_dir = NULL;
+        }
+    }
+    if (!cmng->persistent) {
+        // generate random folder name for storing cache
+        rnd_str = get_random_string (20, TRUE);
+        cmng->cache_dir = g_strdup_printf ("%s/%s",
+            conf_get_string (application_get_conf (cmng->app), "filesystem.cache_dir"), rnd_str);
+        g_free (rnd_str);
+    }
     cmng->cache_hits = 0;
     cmng->cache_miss = 0;
+    cmng->ghost_hits = 0;
+    cmng->ghost_miss = 0;
 
-    cache_mng_rm_cache_dir (cmng);
+    if (!cmng->persistent)
+        cache_mng_rm_cache_dir (cmng);
     if (g_mkdir_with_parents (cmng->cache_dir, 0700) != 0) {
         LOG_err (CMNG_LOG, "Failed to create directory: %s", cmng->cache_dir);
+        cmng->persistent = FALSE;
         cache_mng_destroy (cmng);
         return NULL;
     }
 
+    if (cmng->persistent)
+        cache_mng_index_load (cmng);
+
     return cmng;
 }
 
 void cache_mng_destroy (CacheMng *cmng)
 {
-    cache_mng_rm_cache_dir (cmng);
+    if (cmng->persistent)
+        cache_mng_index_save (cmng);
+    else
+        cache_mng_rm_cache_dir (cmng);
+    if (cmng->lock_fd >= 0)
+        close (cmng->lock_fd);
     g_free (cmng->cache_dir);
-    g_queue_free (cmng->q_lru);
+    event_free (cmng->ev_evict);
+    if (cmng->ev_check)
+        event_free (cmng->ev_check);
+    g_hash_table_destroy (cmng->h_pending);
     g_hash_table_destroy (cmng->h_entries);
+    g_queue_free (cmng->q_blocks);
+    g_queue_free (cmng->q_blocks_small);
+    cache_ghost_list_destroy (cmng->ghosts);
+    g_queue_free (cmng->q_mem_blocks);
+    cache_ghost_list_destroy (cmng->mem_ghosts);
+    g_queue_free (cmng->q_open);
+    g_hash_table_destroy (cmng->h_index);
+    g_hash_table_destroy (cmng->h_fnames);
     g_free (cmng);
 }
 
-static struct _CacheEntry* cache_entry_create (fuse_ino_t ino)
+static struct _CacheEntry* cache_entry_create (CacheMng *cmng, fuse_ino_t ino)
 {
     struct _CacheEntry* entry = g_malloc (sizeof (struct _CacheEntry));
+    char path[PATH_MAX];
 
+    entry->cmng = cmng;
     entry->ino = ino;
     entry->avail_range = range_create ();
-    entry->ll_lru = NULL;
+    entry->h_blocks = g_hash_table_new_full (g_int64_hash, g_int64_equal, NULL, g_free);
+    entry->h_mem_blocks = g_hash_table_new (g_int64_hash, g_int64_equal);
+    entry->write_seq = 0;
     entry->modification_time = time (NULL);
     entry->etag = NULL;
+    entry->fname = g_strdup (g_hash_table_lookup (cmng->h_fnames, GUINT_TO_POINTER (ino)));
+
+    cache_mng_file_name (cmng, path, sizeof (path), ino);
+    entry->path = g_strdup (path);
+    entry->fd = -1;
+    entry->ll_open = NULL;
+    entry->q_io = g_queue_new ();
+    entry->removed = FALSE;
+    entry->pinned = FALSE;
 
     return entry;
 }
 
+// removes all blocks of the entry from the LRU list
+static void cache_entry_drop_blocks (struct _CacheEntry *entry)
+{
+    GHashTableIter iter;
+    gpointer value;
+
+    g_hash_table_iter_init (&iter, entry->h_blocks);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+        struct _CacheBlock *block = (struct _CacheBlock *) value;
+        g_queue_delete_link (block->queue, block->ll_lru);
+    }
+    g_hash_table_remove_all (entry->h_blocks);
+}
+
 static void cache_entry_destroy (gpointer data)
 {
     struct _CacheEntry * entry = (struct _CacheEntry*) data;
 
+    cache_entry_drop_blocks (entry);
+    g_hash_table_destroy (entry->h_blocks);
+    cache_mem_drop_range (entry->cmng, entry, 0, G_MAXUINT64);
+    g_hash_table_destroy (entry->h_mem_blocks);
+    if (entry->fd >= 0)
+        close (entry->fd);
+    if (entry->ll_open)
+        g_queue_delete_link (entry->cmng->q_open, entry->ll_open);
+    g_queue_free (entry->q_io);
+    g_free (entry->fname);
+    g_free (entry->path);
     range_destroy(entry->avail_range);
     if (entry->etag)
         g_free (entry->etag);
     g_free(entry);
 }
 
+/*{{{ memory tier */
+static void cache_mem_block_unref (struct _CacheMemBlock *mblock)
+{
+    if (--mblock->ref)
+        return;
+
+    g_free (mblock->data);
+    g_free (mblock);
+}
+
+// removes the block from the memory tier, readers keep their references
+static void cache_mem_block_remove (CacheMng *cmng, struct _CacheMemBlock *mblock)
+{
+    g_queue_delete_link (cmng->q_mem_blocks, mblock->ll_lru);
+    g_hash_table_remove (mblock->entry->h_mem_blocks, &mblock->idx);
+    cmng->mem_size -= mblock->len;
+    mblock->entry = NULL;
+    cache_mem_block_unref (mblock);
+}
+
+// cached data of [start, end) is modified or evicted
+static void cache_mem_drop_range (CacheMng *cmng, struct _CacheEntry *entry, guint64 start, guint64 end)
+{
+    GHashTableIter iter;
+    gpointer value;
+    GList *l_drop = NULL, *l;
+
+    // disk reads which are in progress must not be promoted
+    entry->write_seq++;
+
+    g_hash_table_iter_init (&iter, entry->h_mem_blocks);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+        struct _CacheMemBlock *mblock = (struct _CacheMemBlock *) value;
+        guint64 mstart = mblock->idx * CMNG_MEM_BLOCK_SIZE;
+
+        if (mstart < end && mstart + mblock->len > start)
+            l_drop = g_list_prepend (l_drop, mblock);
+    }
+
+    for (l = l_drop; l; l = g_list_next (l))
+        cache_mem_block_remove (cmng, (struct _CacheMemBlock *) l->data);
+    g_list_free (l_drop);
+}
+
+// serves the read from the memory tier, returns FALSE if the range is not in memory
+static gboolean cache_mem_retrieve (CacheMng *cmng, struct _CacheEntry *entry, struct _CacheContext *context)
+{
+    struct _CacheMemBlock *mblock;
+    guint64 off = context->off;
+    guint64 end = context->off + context->size;
+    guint64 idx, first, last, pos;
+
+    if (!cmng->mem_max_size || !context->size)
+        return FALSE;
+
+    first = off / CMNG_MEM_BLOCK_SIZE;
+    last = (end - 1) / CMNG_MEM_BLOCK_SIZE;
+
+    for (idx = first; idx <= last; idx++) {
+        mblock = g_hash_table_lookup (entry->h_mem_blocks, &idx);
+        if (!mblock || idx * CMNG_MEM_BLOCK_SIZE + mblock->len < MIN ((idx + 1) * CMNG_MEM_BLOCK_SIZE, end))
+            return FALSE;
+    }
+
+    pos = off;
+    for (idx = first; idx <= last; idx++) {
+        guint64 len;
+
+        mblock = g_hash_table_lookup (entry->h_mem_blocks, &idx);
+        g_queue_unlink (cmng->q_mem_blocks, mblock->ll_lru);
+        g_queue_push_head_link (cmng->q_mem_blocks, mblock->ll_lru);
+
+        // the most common case: no copy at all
+        if (first == last) {
+            mblock->ref++;
+            context->mem_block = mblock;
+            context->buf = mblock->data + (off - idx * CMNG_MEM_BLOCK_SIZE);
+            break;
+        }
+
+        if (!context->buf)
+            context->buf = g_malloc (context->size);
+        len = MIN ((idx + 1) * CMNG_MEM_BLOCK_SIZE, end) - pos;
+        memcpy (context->buf + (pos - off), mblock->data + (pos - idx * CMNG_MEM_BLOCK_SIZE), len);
+        pos += len;
+    }
+
+    context->success = TRUE;
+
+    return TRUE;
+}
+
+// the range is read from the disk, chunks which are read for the second time are kept in memory
+// returns TRUE if the range is served by the memory tier or must be moved there by a buffered read,
+// otherwise remembers it the same way as a disk read does
+static gboolean cache_mem_want_range (CacheMng *cmng, struct _CacheEntry *entry, guint64 off, guint64 size)
+{
+    guint64 end = off + size;
+    guint64 idx;
+
+    if (!cmng->mem_max_size || !size)
+        return FALSE;
+
+    for (idx = off / CMNG_MEM_BLOCK_SIZE; idx * CMNG_MEM_BLOCK_SIZE < end; idx++) {
+        if (g_hash_table_lookup (entry->h_mem_blocks, &idx) ||
+            cache_ghost_list_contains (cmng->mem_ghosts, entry->ino, idx))
+            return TRUE;
+    }
+
+    // blocks which start inside the read range
+    for (idx = (off + CMNG_MEM_BLOCK_SIZE - 1) / CMNG_MEM_BLOCK_SIZE; idx * CMNG_MEM_BLOCK_SIZE < end; idx++)
+        cache_ghost_list_add (cmng->mem_ghosts, entry->ino, idx);
+
+    return FALSE;
+}
+
+static void cache_mem_on_disk_read (CacheMng *cmng, struct _CacheEntry *entry, struct _CacheContext *context)
+{
+    struct _CacheMemBlock *mblock;
+    guint64 end = context->off + context->size;
+    guint64 idx;
+
+    if (!cmng->mem_max_size || !context->size)
+        return;
+
+    // the data might be already modified
+    if (entry->removed || context->write_seq != entry->write_seq)
+        return;
+
+    // blocks which start inside the read range
+    for (idx = (context->off + CMNG_MEM_BLOCK_SIZE - 1) / CMNG_MEM_BLOCK_SIZE; idx * CMNG_MEM_BLOCK_SIZE < end; idx++) {
+        guint64 start = idx * CMNG_MEM_BLOCK_SIZE;
+        guint64 len = MIN (start + CMNG_MEM_BLOCK_SIZE, end) - start;
+
+        mblock = g_hash_table_lookup (entry->h_mem_blocks, &idx);
+        if (mblock && mblock->len >= len)
+            continue;
+
+        // the first read only remembers the chunk
+        if (!cache_ghost_list_remove (cmng->mem_ghosts, entry->ino, idx)) {
+            cache_ghost_list_add (cmng->mem_ghosts, entry->ino, idx);
+            continue;
+        }
+
+        if (mblock)
+            cache_mem_block_remove (cmng, mblock);
+
+        mblock = g_new0 (struct _CacheMemBlock, 1);
+        mblock->entry = entry;
+        mblock->idx = idx;
+        mblock->len = len;
+        mblock->data = g_malloc (len);
+        memcpy (mblock->data, context->buf + (start - context->off), len);
+        mblock->ref = 1;
+        g_hash_table_insert (entry->h_mem_blocks, &mblock->idx, mblock);
+        g_queue_push_head (cmng->q_mem_blocks, mblock);
+        mblock->ll_lru = g_queue_peek_head_link (cmng->q_mem_blocks);
+        cmng->mem_size += len;
+
+        LOG_debug (CMNG_LOG, INO_H"Memory block [%"G_GUINT64_FORMAT":%"G_GUINT64_FORMAT"]", INO_T (entry->ino), start, len);
+    }
+
+    while (cmng->mem_size > cmng->mem_max_size && g_queue_peek_tail (cmng->q_mem_blocks))
+        cache_mem_block_remove (cmng, (struct _CacheMemBlock *) g_queue_peek_tail (cmng->q_mem_blocks));
+}
+/*}}}*/
+
 static struct _CacheContext* cache_context_create (guint64 size, void *user_ctx)
 {
     struct _CacheContext *context = g_malloc (sizeof (struct _CacheContext));
 
+    context->entry = NULL;
+    context->type = CIO_read;
+    context->write_seq = 0;
+    context->mem_block = NULL;
+    context->skip = FALSE;
+    context->off = 0;
     context->user_ctx = user_ctx;
     context->success = FALSE;
     context->size = size;
     context->buf = NULL;
+    context->evbuf = NULL;
     context->ev = NULL;
 
     return context;
@@ -149,16 +781,80 @@ static void cache_context_destroy (struct _CacheContext* context)
 {
     if (context->ev)
         event_free (context->ev);
-    if (context->buf)
+    if (context->mem_block)
+        cache_mem_block_unref (context->mem_block);
+    else if (context->buf)
         g_free (context->buf);
+    if (context->evbuf)
+        evbuffer_free (context->evbuf);
     g_free (context);
 }
 /*}}}*/
 
 /*{{{ utils */
+// name of the persistent cache file, it does not depend on inode number
+static gchar *cache_mng_index_name (const gchar *fname)
+{
+    return g_compute_checksum_for_string (G_CHECKSUM_MD5, fname, -1);
+}
+
 static int cache_mng_file_name (CacheMng *cmng, char *buf, int buflen, fuse_ino_t ino)
 {
-    return snprintf (buf, buflen, "%s/cache_mng_%"INO_FMT"", cmng->cache_dir, INO ino);
+    const gchar *fname;
+    gchar *name;
+    int res;
+
+    fname = g_hash_table_lookup (cmng->h_fnames, GUINT_TO_POINTER (ino));
+    if (!fname)
+        return snprintf (buf, buflen, "%s/cache_mng_%"INO_FMT"", cmng->cache_dir, INO ino);
+
+    name = cache_mng_index_name (fname);
+    res = snprintf (buf, buflen, "%s/%s", cmng->cache_dir, name);
+    g_free (name);
+
+    return res;
+}
+
+// adds an empty entry
+static struct _CacheEntry *cache_mng_entry_add (CacheMng *cmng, fuse_ino_t ino)
+{
+    struct _CacheEntry *entry;
+
+    entry = cache_entry_create (cmng, ino);
+    g_hash_table_insert (cmng->h_entries, GUINT_TO_POINTER (ino), entry);
+
+    return entry;
+}
+
+// blocks of [start, end) are accessed, missing blocks are created
+static void cache_mng_touch_blocks (CacheMng *cmng, struct _CacheEntry *entry, guint64 start, guint64 end)
+{
+    guint64 idx;
+
+    if (start >= end)
+        return;
+
+    for (idx = start / cmng->block_size; idx <= (end - 1) / cmng->block_size; idx++) {
+        struct _CacheBlock *block;
+
+        block = g_hash_table_lookup (entry->h_blocks, &idx);
+        if (block) {
+            cmng->policy->access (cmng, block, FALSE);
+        } else {
+            block = g_new0 (struct _CacheBlock, 1);
+            block->entry = entry;
+            block->idx = idx;
+            g_hash_table_insert (entry->h_blocks, &block->idx, block);
+            cmng->policy->access (cmng, block, TRUE);
+        }
+    }
+}
+
+static void cache_mng_touch_range_cb (guint64 start, guint64 end, gpointer ctx)
+{
+    struct _CacheEntry *entry = (struct _CacheEntry *) ctx;
+
+    cache_mng_touch_blocks (entry->cmng, entry, start, end);
 }
 
 guint64 cache_mng_size (CacheMng *cmng)
@@ -177,6 +873,32 @@ guint64 cache_mng_get_file_length (CacheMng *cmng, fuse_ino_t ino)
     return range_length (entry->avail_range);
 }
 
+gboolean cache_mng_has_range (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off)
+{
+    struct _CacheEntry *entry;
+
+    entry = g_hash_table_lookup (cmng->h_entries, GUINT_TO_POINTER (ino));
+    if (!entry)
+        return FALSE;
+
+    return range_contain (entry->avail_range, off, off + size);
+}
+
+void cache_mng_foreach_missing (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off,
+    cache_mng_on_missing_cb on_missing_cb, void *ctx)
+{
+    struct _CacheEntry *entry;
+
+    entry = g_hash_table_lookup (cmng->h_entries, GUINT_TO_POINTER (ino));
+    if (!entry) {
+        if (size)
+            on_missing_cb (off, off + size, ctx);
+        return;
+    }
+
+    range_foreach_missing (entry->avail_range, off, off + size, on_missing_cb, ctx);
+}
+
 static void cache_mng_rm_cache_dir (CacheMng *cmng)
 {
     if (cmng->cache_dir)
@@ -218,61 +940,162 @@ gboolean cache_mng_update_etag (CacheMng *cmng, fuse_ino_t ino, const gchar *eta
 }
 /*}}}*/
 
-/*{{{ retrieve_file_buf */
-static void cache_read_cb (G_GNUC_UNUSED evutil_socket_t fd, G_GNUC_UNUSED short flags, void *ctx)
+/*{{{ disk io */
+// disk operations are executed in the worker pool,
+// operations of the same entry are executed one by one in the order of submission
+
+// executed in a worker thread
+// writes the content of evbuffer without making it contiguous
+static gboolean cache_io_write_evbuf (int fd, struct evbuffer *evbuf, off_t off)
 {
-    struct _CacheContext *context = (struct _CacheContext *) ctx;
+    struct evbuffer_iovec vec[CMNG_WRITE_IOV];
+    struct iovec iov[CMNG_WRITE_IOV];
+    int i, n;
+    ssize_t res;
 
-    if (context->cb.retrieve_cb)
-        context->cb.retrieve_cb (context->buf, context->size, context->success, context->user_ctx);
-    cache_context_destroy (context);
+    while (evbuffer_get_length (evbuf)) {
+        n = MIN (evbuffer_peek (evbuf, -1, NULL, vec, CMNG_WRITE_IOV), CMNG_WRITE_IOV);
+        for (i = 0; i < n; i++) {
+            iov[i].iov_base = vec[i].iov_base;
+            iov[i].iov_len = vec[i].iov_len;
+        }
+
+        res = pwritev (fd, iov, n, off);
+        if (res <= 0)
+            return FALSE;
+
+        evbuffer_drain (evbuf, res);
+        off += res;
+    }
+
+    return TRUE;
 }
 
-// retrieve file buffer from local storage
-// if success == TRUE then "buf" contains "size" bytes of data
-void cache_mng_retrieve_file_buf (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off,
-    cache_mng_on_retrieve_file_buf_cb on_retrieve_file_buf_cb, void *ctx)
+static void cache_io_task_cb (gpointer ctx)
 {
-    struct _CacheContext *context;
-    struct _CacheEntry *entry;
-
-    context = cache_context_create (size, ctx);
-    context->cb.retrieve_cb = on_retrieve_file_buf_cb;
-    entry = g_hash_table_lookup (cmng->h_entries, GUINT_TO_POINTER (ino));
+    struct _CacheContext *context = (struct _CacheContext *) ctx;
+    struct _CacheEntry *entry = context->entry;
+    ssize_t res;
 
-    if (entry && range_contain (entry->avail_range, off, off + size)) {
-        int fd;
-        ssize_t res;
-        char path[PATH_MAX];
+    if (context->skip)
+        return;
 
-        if (ino != entry->ino) {
-            LOG_err (CMNG_LOG, INO_H"Requested inode doesn't match hashed key!", INO_T (ino));
-            if (context->cb.retrieve_cb)
-                context->cb.retrieve_cb (NULL, 0, FALSE, context->user_ctx);
-            cache_context_destroy (context);
-            cmng->cache_miss++;
+    if (entry->fd < 0) {
+        entry->fd = open (entry->path, O_RDWR|O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if (entry->fd < 0)
             return;
-        }
+    }
 
-        cache_mng_file_name (cmng, path, sizeof (path), ino);
-        fd = open (path, O_RDONLY);
-        if (fd < 0) {
-            LOG_err (CMNG_LOG, INO_H"Failed to open file for reading! Path: %s", INO_T (ino), path);
-            if (context->cb.retrieve_cb)
-                context->cb.retrieve_cb (NULL, 0, FALSE, context->user_ctx);
-            cache_context_destroy (context);
-            cmng->cache_miss++;
-            return;
+    switch (context->type) {
+        case CIO_read:
+            res = pread (entry->fd, context->buf, context->size, context->off);
+            context->success = (res == (ssize_t) context->size);
+            break;
+        case CIO_write:
+            if (context->evbuf) {
+                context->success = cache_io_write_evbuf (entry->fd, context->evbuf, context->off);
+                break;
+            }
+            res = pwrite (entry->fd, context->buf, context->size, context->off);
+            context->success = (res == (ssize_t) context->size);
+            break;
+        case CIO_punch:
+#ifdef FALLOC_FL_PUNCH_HOLE
+            context->success = (fallocate (entry->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                context->off, context->size) == 0);
+#else
+            context->success = FALSE;
+#endif
+            break;
+        case CIO_read_fd:
+            context->cb.read_fd_cb (context->user_ctx, entry->fd, context->off, context->size);
+            context->success = TRUE;
+            break;
+        default:
+            break;
+    }
+}
+
+static void cache_io_on_done_cb (gpointer ctx);
+
+// removes the file of the removed entry, unless a new entry of the same file uses it already
+static void cache_entry_unlink (CacheMng *cmng, struct _CacheEntry *entry)
+{
+    struct _CacheEntry *cur;
+
+    cur = g_hash_table_lookup (cmng->h_entries, GUINT_TO_POINTER (entry->ino));
+    if (cur && !g_strcmp0 (cur->path, entry->path))
+        return;
+
+    unlink (entry->path);
+}
+
+static void cache_io_start (struct _CacheContext *context)
+{
+    // queued operations of the removed entry are failed
+    if (context->entry->removed)
+        context->skip = TRUE;
+
+    if (!worker_pool_push (application_get_worker_pool (context->entry->cmng->app),
+        cache_io_task_cb, cache_io_on_done_cb, context)) {
+        LOG_err (CMNG_LOG, INO_H"Failed to queue disk operation !", INO_T (context->entry->ino));
+        context->skip = TRUE;
+        cache_io_on_done_cb (context);
+    }
+}
+
+static void cache_io_submit (struct _CacheEntry *entry, struct _CacheContext *context)
+{
+    context->entry = entry;
+    g_queue_push_tail (entry->q_io, context);
+
+    if (g_queue_get_length (entry->q_io) == 1)
+        cache_io_start (context);
+}
+
+// move entry to the front of q_open, close descriptors of idle entries which are not used for a long time
+static void cache_io_update_open_files (CacheMng *cmng, struct _CacheEntry *entry)
+{
+    struct _CacheEntry *tail;
+
+    if (entry->fd >= 0) {
+        if (entry->ll_open) {
+            g_queue_unlink (cmng->q_open, entry->ll_open);
+            g_queue_push_head_link (cmng->q_open, entry->ll_open);
+        } else {
+            g_queue_push_head (cmng->q_open, entry);
+            entry->ll_open = g_queue_peek_head_link (cmng->q_open);
         }
+    }
 
-        context->buf = g_malloc (size);
-        res = pread (fd, context->buf, size, off);
-        close (fd);
-        context->success = (res == (ssize_t) size);
+    while (g_queue_get_length (cmng->q_open) > CMNG_MAX_OPEN_FILES) {
+        tail = (struct _CacheEntry *) g_queue_peek_tail (cmng->q_open);
+        if (!g_queue_is_empty (tail->q_io))
+            break;
 
-        LOG_debug (CMNG_LOG, INO_H"Read [%"OFF_FMT":%zu] bytes, result: %s",
-            INO_T (ino), off, size, context->success ? "OK" : "Failed");
+        close (tail->fd);
+        tail->fd = -1;
+        g_queue_delete_link (cmng->q_open, tail->ll_open);
+        tail->ll_open = NULL;
+    }
+}
 
+// executed in the event loop thread
+static void cache_io_on_done_cb (gpointer ctx)
+{
+    struct _CacheContext *context = (struct _CacheContext *) ctx;
+    struct _CacheEntry *entry = context->entry;
+    CacheMng *cmng = entry->cmng;
+    fuse_ino_t ino = entry->ino;
+
+    g_queue_pop_head (entry->q_io);
+
+    LOG_debug (CMNG_LOG, INO_H"%s [%"OFF_FMT":%"G_GUINT64_FORMAT"] bytes, result: %s",
+        INO_T (ino), context->type == CIO_read ? "Read" : (context->type == CIO_write ? "Written" :
+            (context->type == CIO_punch ? "Deallocated" : "Passed to reader")),
+        context->off, context->size, context->success ? "OK" : "Failed");
+
+    if (context->type == CIO_read) {
         if (!context->success) {
             g_free (context->buf);
             context->buf = NULL;
@@ -280,88 +1103,315 @@ void cache_mng_retrieve_file_buf (CacheMng *cmng, fuse_ino_t ino, size_t size, o
             cmng->cache_miss++;
         } else
             cmng->cache_hits++;
+    }
 
-        // move entry to the front of q_lru
-        g_queue_unlink (cmng->q_lru, entry->ll_lru);
-        g_queue_push_head_link (cmng->q_lru, entry->ll_lru);
-    } else {
-        LOG_debug (CMNG_LOG, INO_H"Entry isn't found or doesn't contain requested range: [%"OFF_FMT": %"OFF_FMT"]",
-            INO_T (ino), off, off + size);
+    // start the next operation of this entry
+    if (!g_queue_is_empty (entry->q_io)) {
+        cache_io_start ((struct _CacheContext *) g_queue_peek_head (entry->q_io));
+    } else if (entry->removed) {
+        cache_entry_unlink (cmng, entry);
+        cache_entry_destroy (entry);
+        entry = NULL;
+    }
+
+    if (entry)
+        cache_io_update_open_files (cmng, entry);
+
+    if (context->type == CIO_read && context->success && entry)
+        cache_mem_on_disk_read (cmng, entry, context);
+
+    // data is not on the disk, forget about the whole file
+    if (context->type == CIO_write && !context->success && entry && !entry->removed) {
+        LOG_err (CMNG_LOG, INO_H"Failed to write to cache file !", INO_T (ino));
+        cache_mng_remove_file (cmng, ino);
+    }
+
+    // evicted data is not available anyway, disk space is just not released
+    if (context->type == CIO_punch && !context->success && !context->skip)
+        LOG_debug (CMNG_LOG, INO_H"Failed to deallocate evicted block", INO_T (ino));
+
+    if (context->type == CIO_write) {
+        if (context->cb.store_cb)
+            context->cb.store_cb (context->success, context->user_ctx);
+    } else if (context->type == CIO_read) {
+        if (context->cb.retrieve_cb)
+            context->cb.retrieve_cb (context->buf, context->size, context->success, context->user_ctx);
+    } else if (context->type == CIO_read_fd) {
+        // the operation is not executed, the reader still waits for the reply
+        if (!context->success)
+            context->cb.read_fd_cb (context->user_ctx, -1, context->off, context->size);
+    }
+
+    cache_context_destroy (context);
+}
+/*}}}*/
+
+/*{{{ retrieve_file_buf */
+static void cache_read_cb (G_GNUC_UNUSED evutil_socket_t fd, G_GNUC_UNUSED short flags, void *ctx)
+{
+    struct _CacheContext *context = (struct _CacheContext *) ctx;
+
+    if (context->cb.retrieve_cb)
+        context->cb.retrieve_cb (context->buf, context->size, context->success, context->user_ctx);
+    cache_context_destroy (context);
+}
+
+// retrieve file buffer from local storage
+// if success == TRUE then "buf" contains "size" bytes of data
+void cache_mng_retrieve_file_buf (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off,
+    cache_mng_on_retrieve_file_buf_cb on_retrieve_file_buf_cb, void *ctx)
+{
+    struct _CacheContext *context;
+    struct _CacheEntry *entry;
+
+    context = cache_context_create (size, ctx);
+    context->cb.retrieve_cb = on_retrieve_file_buf_cb;
+    entry = g_hash_table_lookup (cmng->h_entries, GUINT_TO_POINTER (ino));
 
-        cmng->cache_miss++;
+    if (entry && range_contain (entry->avail_range, off, off + size)) {
+        if (ino != entry->ino) {
+            LOG_err (CMNG_LOG, INO_H"Requested inode doesn't match hashed key!", INO_T (ino));
+            if (context->cb.retrieve_cb)
+                context->cb.retrieve_cb (NULL, 0, FALSE, context->user_ctx);
+            cache_context_destroy (context);
+            cmng->cache_miss++;
+            return;
+        }
+
+        cache_mng_touch_blocks (cmng, entry, off, off + size);
+
+        context->off = off;
+
+        // hot data is served without disk I/O
+        if (cache_mem_retrieve (cmng, entry, context)) {
+            LOG_debug (CMNG_LOG, INO_H"Read [%"OFF_FMT":%zu] bytes from memory", INO_T (ino), off, size);
+            cmng->cache_hits++;
+
+            context->ev = event_new (application_get_evbase (cmng->app), -1,  0,
+                            cache_read_cb, context);
+            // fire this event at once
+            event_active (context->ev, 0, 0);
+            event_add (context->ev, NULL);
+            return;
+        }
+
+        context->write_seq = entry->write_seq;
+        context->buf = g_malloc (size);
+        cache_io_submit (entry, context);
+        return;
     }
 
+    LOG_debug (CMNG_LOG, INO_H"Entry isn't found or doesn't contain requested range: [%"OFF_FMT": %"OFF_FMT"]",
+        INO_T (ino), off, off + size);
+
+    cmng->cache_miss++;
+
     context->ev = event_new (application_get_evbase (cmng->app), -1,  0,
                     cache_read_cb, context);
     // fire this event at once
     event_active (context->ev, 0, 0);
     event_add (context->ev, NULL);
 }
-/*}}}*/
 
-/*{{{ store_file_buf */
-static void cache_write_cb (G_GNUC_UNUSED evutil_socket_t fd, G_GNUC_UNUSED short flags, void *ctx)
+// the read is a disk operation of the entry: the range is not modified or deallocated
+// by the operations queued after it until "on_read_file_fd_cb" returns
+gboolean cache_mng_read_file_fd (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off,
+    cache_mng_on_read_file_fd_cb on_read_file_fd_cb, void *ctx)
 {
-    struct _CacheContext *context = (struct _CacheContext *) ctx;
+    struct _CacheEntry *entry;
+    struct _CacheContext *context;
 
-    if (context->cb.store_cb)
-        context->cb.store_cb (context->success, context->user_ctx);
+    entry = g_hash_table_lookup (cmng->h_entries, GUINT_TO_POINTER (ino));
+    if (!entry || entry->removed || !range_contain (entry->avail_range, off, off + size))
+        return FALSE;
 
-    cache_context_destroy (context);
+    // data might be not written yet
+    if (!g_queue_is_empty (entry->q_io))
+        return FALSE;
+
+    // the file is opened by a disk operation, open () would block the event loop
+    if (entry->fd < 0)
+        return FALSE;
+
+    if (cache_mem_want_range (cmng, entry, off, size))
+        return FALSE;
+
+    cache_io_update_open_files (cmng, entry);
+    cache_mng_touch_blocks (cmng, entry, off, off + size);
+    cmng->cache_hits++;
+
+    context = cache_context_create (size, ctx);
+    context->cb.read_fd_cb = on_read_file_fd_cb;
+    context->type = CIO_read_fd;
+    context->off = off;
+    cache_io_submit (entry, context);
+
+    return TRUE;
 }
+/*}}}*/
 
-// store file buffer into local storage
-// if success == TRUE then "buf" successfuly stored on disc
-void cache_mng_store_file_buf (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off, unsigned char *buf,
-    cache_mng_on_store_file_buf_cb on_store_file_buf_cb, void *ctx)
+/*{{{ eviction */
+// removes the block from the cache, the rest of the file is kept
+static void cache_mng_evict_block (CacheMng *cmng, struct _CacheBlock *block)
 {
+    struct _CacheEntry *entry = block->entry;
     struct _CacheContext *context;
-    struct _CacheEntry *entry;
-    ssize_t res;
-    int fd;
-    char path[PATH_MAX];
+    guint64 start, end;
     guint64 old_length, new_length;
-    guint64 range_size;
-    time_t now;
 
-    range_size = (guint64)(off + size);
+    start = block->idx * cmng->block_size;
+    end = start + cmng->block_size;
+    cache_mem_drop_range (cmng, entry, start, end);
 
-    // limit the number of cache checks
-    now = time (NULL);
-    if (cmng->check_time < now && now - cmng->check_time >= 10) {
-        // remove data until we have at least size bytes of max_size left
-        while (cmng->max_size < cmng->size + size && g_queue_peek_tail (cmng->q_lru)) {
-            entry = (struct _CacheEntry *) g_queue_peek_tail (cmng->q_lru);
+    g_queue_delete_link (block->queue, block->ll_lru);
+    g_hash_table_remove (entry->h_blocks, &block->idx);
+
+    old_length = range_length (entry->avail_range);
+    range_remove (entry->avail_range, start, end);
+    new_length = range_length (entry->avail_range);
+    cmng->size -= old_length - new_length;
 
-            cache_mng_remove_file (cmng, entry->ino);
+    LOG_debug (CMNG_LOG, INO_H"Evicting block [%"G_GUINT64_FORMAT":%"G_GUINT64_FORMAT"]", INO_T (entry->ino), start, end);
+
+    if (!g_hash_table_size (entry->h_blocks) && !entry->pinned) {
+        cache_mng_remove_file (cmng, entry->ino);
+        return;
+    }
+
+    // release disk space after the reads of the block which are queued before
+    context = cache_context_create (cmng->block_size, NULL);
+    context->type = CIO_punch;
+    context->off = start;
+    cache_io_submit (entry, context);
+}
+
+// returns the size which the cache must not exceed: the configured maximum,
+// or less if the cache filesystem is running out of free space
+static guint64 cache_mng_capacity (CacheMng *cmng)
+{
+    struct statvfs st;
+    time_t now = time (NULL);
+
+    // limit the number of statvfs calls
+    if (cmng->statvfs_time != now) {
+        cmng->statvfs_time = now;
+        if (statvfs (cmng->cache_dir, &st) == 0) {
+            guint64 avail = (guint64) st.f_bavail * st.f_frsize;
+
+            if (cmng->size + avail > cmng->min_free_size)
+                cmng->disk_limit = cmng->size + avail - cmng->min_free_size;
+            else
+                cmng->disk_limit = 0;
+        } else {
+            LOG_debug (CMNG_LOG, "Failed to get free space of %s: %s", cmng->cache_dir, strerror (errno));
+            cmng->disk_limit = G_MAXUINT64;
         }
-        cmng->check_time = now;
     }
 
-    context = cache_context_create (size, ctx);
-    context->cb.store_cb = on_store_file_buf_cb;
+    return MIN (cmng->max_size, cmng->disk_limit);
+}
 
-    cache_mng_file_name (cmng, path, sizeof (path), ino);
-    fd = open (path, O_WRONLY|O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-    if (fd < 0) {
-        LOG_err (CMNG_LOG, INO_H"Failed to create / open file for writing! Path: %s", INO_T (ino), path);
-        if (context->cb.store_cb)
-            context->cb.store_cb (FALSE, context->user_ctx);
-        cache_context_destroy (context);
-        return;
+// evicts data until the cache size is not greater than "target", returns the number of evicted blocks
+static guint cache_mng_evict (CacheMng *cmng, guint64 target, guint max_blocks)
+{
+    struct _CacheBlock *block;
+    guint evicted = 0;
+
+    // files which are not opened since the mount go first
+    while (cmng->size > target && evicted < max_blocks && g_hash_table_size (cmng->h_index)) {
+        GHashTableIter iter;
+        gpointer key;
+
+        g_hash_table_iter_init (&iter, cmng->h_index);
+        if (g_hash_table_iter_next (&iter, &key, NULL))
+            cache_mng_index_remove (cmng, (const gchar *) key);
+        evicted++;
     }
-    res = pwrite(fd, buf, size, off);
-    close (fd);
 
-    entry = g_hash_table_lookup (cmng->h_entries, GUINT_TO_POINTER (ino));
+    while (cmng->size > target && evicted < max_blocks && (block = cmng->policy->victim (cmng))) {
+        cache_mng_evict_block (cmng, block);
+        evicted++;
+    }
 
-    if (!entry) {
-        entry = cache_entry_create (ino);
-        g_queue_push_head (cmng->q_lru, entry);
-        entry->ll_lru = g_queue_peek_head_link (cmng->q_lru);
-        g_hash_table_insert (cmng->h_entries, GUINT_TO_POINTER (ino), entry);
+    return evicted;
+}
+
+// background eviction, runs in batches until the cache size drops below the low watermark
+static void cache_mng_on_evict_cb (G_GNUC_UNUSED evutil_socket_t fd, G_GNUC_UNUSED short flags, void *ctx)
+{
+    CacheMng *cmng = (CacheMng *) ctx;
+    guint64 low_size = cache_mng_capacity (cmng) * cmng->low_watermark / 100;
+    struct timeval tv = {0, 0};
+
+    LOG_debug (CMNG_LOG, "Evicting cached data, size: %"G_GUINT64_FORMAT" low watermark: %"G_GUINT64_FORMAT,
+        cmng->size, low_size);
+
+    // let other events run between batches
+    if (cache_mng_evict (cmng, low_size, CMNG_EVICT_BATCH) == CMNG_EVICT_BATCH && cmng->size > low_size)
+        evtimer_add (cmng->ev_evict, &tv);
+}
+
+// starts background eviction once the cache size crosses the high watermark
+static void cache_mng_check_watermark (CacheMng *cmng)
+{
+    struct timeval tv = {0, 0};
+
+    if (evtimer_pending (cmng->ev_evict, NULL))
+        return;
+
+    if (cmng->size <= cache_mng_capacity (cmng) * cmng->high_watermark / 100)
+        return;
+
+    evtimer_add (cmng->ev_evict, &tv);
+}
+
+static void cache_mng_on_check_cb (G_GNUC_UNUSED evutil_socket_t fd, G_GNUC_UNUSED short flags, void *ctx)
+{
+    CacheMng *cmng = (CacheMng *) ctx;
+
+    if (cmng->size)
+        cache_mng_check_watermark (cmng);
+}
+
+static void cache_mng_add_missing_cb (guint64 start, guint64 end, void *ctx)
+{
+    guint64 *missing = (guint64 *) ctx;
+
+    *missing += end - start;
+}
+/*}}}*/
+
+/*{{{ store_file_buf */
+// store file buffer into local storage
+// if success == TRUE then "buf" successfuly stored on disc
+// adds the range of write operation to the entry and submits the operation
+// accounts the range as stored, returns the entry which receives the data
+static struct _CacheEntry *cache_mng_store_range (CacheMng *cmng, fuse_ino_t ino, guint64 size, off_t off)
+{
+    struct _CacheEntry *entry;
+    guint64 old_length, new_length;
+    guint64 range_size;
+    guint64 capacity, growth = 0;
+
+    range_size = (guint64)(off + size);
+
+    entry = g_hash_table_lookup (cmng->h_entries, GUINT_TO_POINTER (ino));
+    if (!entry)
+        entry = cache_mng_entry_add (cmng, ino);
+
+    // the limit is never exceeded: make room for the new data at once,
+    // the entry keeps its path and ETag even if all its blocks are evicted
+    cache_mng_foreach_missing (cmng, ino, size, off, cache_mng_add_missing_cb, &growth);
+    capacity = cache_mng_capacity (cmng);
+    if (cmng->size + growth > capacity) {
+        entry->pinned = TRUE;
+        cache_mng_evict (cmng, capacity > growth ? capacity - growth : 0, G_MAXUINT);
+        entry->pinned = FALSE;
     }
 
+    cache_mem_drop_range (cmng, entry, off, range_size);
+
+    // the range is available at once: reads of this entry are queued after the write
     old_length = range_length (entry->avail_range);
     range_add (entry->avail_range, off, range_size);
     new_length = range_length (entry->avail_range);
@@ -372,19 +1422,506 @@ void cache_mng_store_file_buf (CacheMng *cmng, fuse_ino_t ino, size_t size, off_
             INO_T (ino), new_length, old_length);
     }
 
+    cache_mng_touch_blocks (cmng, entry, off, range_size);
+
     // update modification time
     entry->modification_time = time (NULL);
 
-    context->success = (res == (ssize_t) size);
+    return entry;
+}
 
-    LOG_debug (CMNG_LOG, INO_H"Written [%"OFF_FMT":%zu] bytes, result: %s",
-        INO_T (ino), off, size, context->success ? "OK" : "Failed");
+static void cache_mng_store_context (CacheMng *cmng, fuse_ino_t ino, struct _CacheContext *context)
+{
+    struct _CacheEntry *entry;
 
-    context->ev = event_new (application_get_evbase (cmng->app), -1,  0,
-                    cache_write_cb, context);
-    // fire this event at once
-    event_active (context->ev, 0, 0);
-    event_add (context->ev, NULL);
+    entry = cache_mng_store_range (cmng, ino, context->size, context->off);
+    cache_io_submit (entry, context);
+
+    cache_mng_check_watermark (cmng);
+}
+
+// appends data to the last queued write of the entry if it's not started yet and ends at "off",
+// a stream of small writes costs a single disk operation
+static gboolean cache_io_coalesce (struct _CacheEntry *entry, size_t size, off_t off, unsigned char *buf)
+{
+    struct _CacheContext *tail;
+
+    if (g_queue_get_length (entry->q_io) < 2)
+        return FALSE;
+
+    tail = (struct _CacheContext *) g_queue_peek_tail (entry->q_io);
+    if (tail->type != CIO_write || tail->skip || tail->cb.store_cb ||
+        tail->off + (off_t) tail->size != off || tail->size + size > CMNG_COALESCE_MAX_SIZE)
+        return FALSE;
+
+    if (!tail->evbuf) {
+        tail->evbuf = evbuffer_new ();
+        evbuffer_add (tail->evbuf, tail->buf, tail->size);
+        g_free (tail->buf);
+        tail->buf = NULL;
+    }
+    evbuffer_add (tail->evbuf, buf, size);
+    tail->size += size;
+
+    return TRUE;
+}
+
+void cache_mng_store_file_buf (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off, unsigned char *buf,
+    cache_mng_on_store_file_buf_cb on_store_file_buf_cb, void *ctx)
+{
+    struct _CacheContext *context;
+    struct _CacheEntry *entry;
+
+    entry = cache_mng_store_range (cmng, ino, size, off);
+
+    // nobody waits for this write, merge it with the previous one
+    if (!on_store_file_buf_cb && size && cache_io_coalesce (entry, size, off, buf)) {
+        cache_mng_check_watermark (cmng);
+        return;
+    }
+
+    context = cache_context_create (size, ctx);
+    context->cb.store_cb = on_store_file_buf_cb;
+    context->type = CIO_write;
+    context->off = off;
+    // caller's buffer is not valid after this call returns
+    context->buf = g_malloc (size);
+    if (size)
+        memcpy (context->buf, buf, size);
+
+    cache_io_submit (entry, context);
+    cache_mng_check_watermark (cmng);
+}
+
+void cache_mng_store_file_evbuf (CacheMng *cmng, fuse_ino_t ino, off_t off, struct evbuffer *evbuf,
+    cache_mng_on_store_file_buf_cb on_store_file_buf_cb, void *ctx)
+{
+    struct _CacheContext *context;
+
+    context = cache_context_create (evbuffer_get_length (evbuf), ctx);
+    context->cb.store_cb = on_store_file_buf_cb;
+    context->type = CIO_write;
+    context->off = off;
+    // take the data over without copying
+    context->evbuf = evbuffer_new ();
+    evbuffer_add_buffer (context->evbuf, evbuf);
+
+    cache_mng_store_context (cmng, ino, context);
+}
+/*}}}*/
+
+/*{{{ pending */
+static void cache_pending_destroy (struct _CachePending *pending)
+{
+    GList *l;
+
+    for (l = g_list_first (pending->l_waiters); l; l = g_list_next (l))
+        g_free (l->data);
+    g_list_free (pending->l_waiters);
+    g_free (pending);
+}
+
+static void cache_pending_list_destroy (gpointer data)
+{
+    GList *l;
+
+    for (l = g_list_first ((GList *) data); l; l = g_list_next (l))
+        cache_pending_destroy ((struct _CachePending *) l->data);
+    g_list_free ((GList *) data);
+}
+
+// returns pending download which contains the whole range
+static struct _CachePending *cache_mng_pending_find (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off)
+{
+    GList *l;
+
+    for (l = g_hash_table_lookup (cmng->h_pending, GUINT_TO_POINTER (ino)); l; l = g_list_next (l)) {
+        struct _CachePending *pending = (struct _CachePending *) l->data;
+
+        if (pending->start <= (guint64) off && pending->end >= (guint64) off + size)
+            return pending;
+    }
+
+    return NULL;
+}
+
+void cache_mng_pending_add (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off)
+{
+    struct _CachePending *pending;
+    GList *l_pending;
+
+    pending = g_new0 (struct _CachePending, 1);
+    pending->start = off;
+    pending->end = off + size;
+
+    // the list head might change, steal it from the hash table
+    l_pending = g_hash_table_lookup (cmng->h_pending, GUINT_TO_POINTER (ino));
+    g_hash_table_steal (cmng->h_pending, GUINT_TO_POINTER (ino));
+    l_pending = g_list_prepend (l_pending, pending);
+    g_hash_table_insert (cmng->h_pending, GUINT_TO_POINTER (ino), l_pending);
+
+    LOG_debug (CMNG_LOG, INO_H"Pending [%"OFF_FMT":%zu]", INO_T (ino), off, size);
+}
+
+gboolean cache_mng_pending_exists (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off)
+{
+    return cache_mng_pending_find (cmng, ino, size, off) != NULL;
+}
+
+gboolean cache_mng_pending_wait (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off,
+    cache_mng_on_pending_done_cb on_pending_done_cb, void *ctx)
+{
+    struct _CachePending *pending;
+    struct _CacheWaiter *waiter;
+
+    pending = cache_mng_pending_find (cmng, ino, size, off);
+    if (!pending)
+        return FALSE;
+
+    waiter = g_new0 (struct _CacheWaiter, 1);
+    waiter->on_pending_done_cb = on_pending_done_cb;
+    waiter->ctx = ctx;
+    pending->l_waiters = g_list_append (pending->l_waiters, waiter);
+
+    LOG_debug (CMNG_LOG, INO_H"Waiting for pending [%"OFF_FMT":%zu]", INO_T (ino), off, size);
+
+    return TRUE;
+}
+
+void cache_mng_pending_done (CacheMng *cmng, fuse_ino_t ino, size_t size, off_t off, gboolean success)
+{
+    struct _CachePending *pending = NULL;
+    GList *l_pending, *l;
+
+    l_pending = g_hash_table_lookup (cmng->h_pending, GUINT_TO_POINTER (ino));
+    for (l = l_pending; l; l = g_list_next (l)) {
+        struct _CachePending *tmp = (struct _CachePending *) l->data;
+
+        if (tmp->start == (guint64) off && tmp->end == (guint64) off + size) {
+            pending = tmp;
+            break;
+        }
+    }
+
+    if (!pending) {
+        LOG_err (CMNG_LOG, INO_H"Pending range not found: [%"OFF_FMT":%zu]", INO_T (ino), off, size);
+        return;
+    }
+
+    // unlink it first, waiters might add new pending ranges
+    g_hash_table_steal (cmng->h_pending, GUINT_TO_POINTER (ino));
+    l_pending = g_list_delete_link (l_pending, l);
+    if (l_pending)
+        g_hash_table_insert (cmng->h_pending, GUINT_TO_POINTER (ino), l_pending);
+
+    for (l = g_list_first (pending->l_waiters); l; l = g_list_next (l)) {
+        struct _CacheWaiter *waiter = (struct _CacheWaiter *) l->data;
+        waiter->on_pending_done_cb (success, waiter->ctx);
+    }
+
+    cache_pending_destroy (pending);
+}
+/*}}}*/
+
+/*{{{ persistent index */
+// the index is a key file: group name is the name of cache file,
+// "path" is the object path, "etag" is the ETag of cached data and "ranges" is a list of "start-end" intervals
+
+static gchar *cache_mng_index_path (CacheMng *cmng)
+{
+    return g_strdup_printf ("%s/index", cmng->cache_dir);
+}
+
+// several mounts must not share the same folder, returns FALSE if it's used by another one
+static gboolean cache_mng_index_lock (CacheMng *cmng, const gchar *cache_dir)
+{
+    gchar *lock_path;
+
+    if (g_mkdir_with_parents (cache_dir, 0700) != 0) {
+        LOG_err (CMNG_LOG, "Failed to create directory: %s", cache_dir);
+        return FALSE;
+    }
+
+    lock_path = g_strdup_printf ("%s/"CMNG_LOCK_NAME, cache_dir);
+    cmng->lock_fd = open (lock_path, O_RDWR | O_CREAT, 0600);
+    if (cmng->lock_fd < 0) {
+        LOG_err (CMNG_LOG, "Failed to open lock file %s: %s", lock_path, strerror (errno));
+        g_free (lock_path);
+        return FALSE;
+    }
+
+    if (flock (cmng->lock_fd, LOCK_EX | LOCK_NB) < 0) {
+        LOG_err (CMNG_LOG, "Persistent cache %s is used by another process, disabling persistent cache: %s",
+            cache_dir, strerror (errno));
+        close (cmng->lock_fd);
+        cmng->lock_fd = -1;
+        g_free (lock_path);
+        return FALSE;
+    }
+
+    g_free (lock_path);
+
+    return TRUE;
+}
+
+static void cache_index_record_destroy (gpointer data)
+{
+    struct _CacheIndexRecord *record = (struct _CacheIndexRecord *) data;
+
+    g_free (record->fname);
+    g_free (record->etag);
+    if (record->range)
+        range_destroy (record->range);
+    g_free (record->path);
+    g_free (record);
+}
+
+// removes loaded entry together with its data
+static void cache_mng_index_remove (CacheMng *cmng, const gchar *fname)
+{
+    struct _CacheIndexRecord *record;
+
+    record = g_hash_table_lookup (cmng->h_index, fname);
+    if (!record)
+        return;
+
+    cmng->size -= range_length (record->range);
+    unlink (record->path);
+    g_hash_table_remove (cmng->h_index, fname);
+}
+
+static struct _CacheIndexRecord *cache_mng_index_load_record (CacheMng *cmng, GKeyFile *key_file, const gchar *group)
+{
+    struct _CacheIndexRecord *record;
+    gchar **ranges;
+    gsize i, ranges_num = 0;
+    guint64 max_end = 0;
+    gchar *name;
+    struct stat st;
+
+    record = g_new0 (struct _CacheIndexRecord, 1);
+    record->fname = g_key_file_get_string (key_file, group, "path", NULL);
+    record->etag = g_key_file_get_string (key_file, group, "etag", NULL);
+    record->range = range_create ();
+    record->path = g_strdup_printf ("%s/%s", cmng->cache_dir, group);
+
+    if (!record->fname || !record->etag) {
+        cache_index_record_destroy (record);
+        return NULL;
+    }
+
+    // file name must match the object path
+    name = cache_mng_index_name (record->fname);
+    if (strcmp (name, group)) {
+        g_free (name);
+        cache_index_record_destroy (record);
+        return NULL;
+    }
+    g_free (name);
+
+    ranges = g_key_file_get_string_list (key_file, group, "ranges", &ranges_num, NULL);
+    for (i = 0; ranges && i < ranges_num; i++) {
+        guint64 start, end;
+
+        if (sscanf (ranges[i], "%"G_GUINT64_FORMAT"-%"G_GUINT64_FORMAT, &start, &end) != 2 || start > end) {
+            g_strfreev (ranges);
+            cache_index_record_destroy (record);
+            return NULL;
+        }
+        range_add (record->range, start, end);
+        if (max_end < end)
+            max_end = end;
+    }
+    g_strfreev (ranges);
+
+    // cached data must be on the disk
+    if (!range_length (record->range) || stat (record->path, &st) != 0 || (guint64) st.st_size < max_end) {
+        cache_index_record_destroy (record);
+        return NULL;
+    }
+
+    return record;
+}
+
+// loads the index of the persistent cache and removes files which are not in the index
+static void cache_mng_index_load (CacheMng *cmng)
+{
+    GKeyFile *key_file;
+    gchar *index_path;
+    gchar **groups;
+    gsize i, groups_num = 0;
+    GError *error = NULL;
+    GDir *dir;
+    const gchar *name;
+
+    index_path = cache_mng_index_path (cmng);
+    key_file = g_key_file_new ();
+
+    if (!g_key_file_load_from_file (key_file, index_path, G_KEY_FILE_NONE, &error)) {
+        LOG_msg (CMNG_LOG, "Cache index is not loaded: %s", error->message);
+        g_error_free (error);
+    } else {
+        groups = g_key_file_get_groups (key_file, &groups_num);
+        for (i = 0; i < groups_num; i++) {
+            struct _CacheIndexRecord *record;
+
+            record = cache_mng_index_load_record (cmng, key_file, groups[i]);
+            if (!record) {
+                LOG_debug (CMNG_LOG, "Dropping invalid cache index entry: %s", groups[i]);
+                continue;
+            }
+
+            cmng->size += range_length (record->range);
+            g_hash_table_replace (cmng->h_index, record->fname, record);
+        }
+        g_strfreev (groups);
+    }
+    g_key_file_free (key_file);
+
+    // the index is written on shutdown, do not trust it after a crash
+    unlink (index_path);
+    g_free (index_path);
+
+    // remove files which are not in the index
+    dir = g_dir_open (cmng->cache_dir, 0, NULL);
+    while (dir && (name = g_dir_read_name (dir))) {
+        GHashTableIter iter;
+        gpointer value;
+        gboolean found = FALSE;
+        gchar *path;
+
+        // removed lock file would let another mount take the folder
+        if (!strcmp (name, CMNG_LOCK_NAME))
+            continue;
+
+        path = g_strdup_printf ("%s/%s", cmng->cache_dir, name);
+        g_hash_table_iter_init (&iter, cmng->h_index);
+        while (!found && g_hash_table_iter_next (&iter, NULL, &value))
+            found = !strcmp (((struct _CacheIndexRecord *) value)->path, path);
+
+        if (!found)
+            unlink (path);
+        g_free (path);
+    }
+    if (dir)
+        g_dir_close (dir);
+
+    LOG_msg (CMNG_LOG, "Loaded %u cached files, total size: %"G_GUINT64_FORMAT" bytes",
+        g_hash_table_size (cmng->h_index), cmng->size);
+}
+
+static void cache_mng_index_add_range_cb (guint64 start, guint64 end, gpointer ctx)
+{
+    GPtrArray *a_ranges = (GPtrArray *) ctx;
+
+    g_ptr_array_add (a_ranges, g_strdup_printf ("%"G_GUINT64_FORMAT"-%"G_GUINT64_FORMAT, start, end));
+}
+
+static void cache_mng_index_add (GKeyFile *key_file, const gchar *fname, const gchar *etag, Range *range)
+{
+    GPtrArray *a_ranges;
+    gchar *group;
+
+    group = cache_mng_index_name (fname);
+    a_ranges = g_ptr_array_new_with_free_func (g_free);
+    range_foreach (range, cache_mng_index_add_range_cb, a_ranges);
+
+    g_key_file_set_string (key_file, group, "path", fname);
+    g_key_file_set_string (key_file, group, "etag", etag);
+    g_key_file_set_string_list (key_file, group, "ranges", (const gchar * const *) a_ranges->pdata, a_ranges->len);
+
+    g_ptr_array_free (a_ranges, TRUE);
+    g_free (group);
+}
+
+// writes the index of the persistent cache
+static void cache_mng_index_save (CacheMng *cmng)
+{
+    GKeyFile *key_file;
+    GHashTableIter iter;
+    gpointer value;
+    gchar *index_path;
+    gchar *data;
+    gsize data_len;
+    GError *error = NULL;
+    guint count = 0;
+
+    key_file = g_key_file_new ();
+
+    g_hash_table_iter_init (&iter, cmng->h_entries);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+        struct _CacheEntry *entry = (struct _CacheEntry *) value;
+
+        // data without ETag can't be validated, unfinished writes leave holes
+        if (!entry->fname || !entry->etag || !g_queue_is_empty (entry->q_io) || !range_length (entry->avail_range))
+            continue;
+
+        cache_mng_index_add (key_file, entry->fname, entry->etag, entry->avail_range);
+        count++;
+    }
+
+    g_hash_table_iter_init (&iter, cmng->h_index);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+        struct _CacheIndexRecord *record = (struct _CacheIndexRecord *) value;
+
+        cache_mng_index_add (key_file, record->fname, record->etag, record->range);
+        count++;
+    }
+
+    index_path = cache_mng_index_path (cmng);
+    data = g_key_file_to_data (key_file, &data_len, NULL);
+    if (!g_file_set_contents (index_path, data, data_len, &error)) {
+        LOG_err (CMNG_LOG, "Failed to write cache index: %s", error->message);
+        g_error_free (error);
+    } else {
+        LOG_msg (CMNG_LOG, "Cache index is saved, files: %u", count);
+    }
+
+    g_free (data);
+    g_free (index_path);
+    g_key_file_free (key_file);
+}
+
+void cache_mng_set_file_path (CacheMng *cmng, fuse_ino_t ino, const gchar *fname, gboolean is_new)
+{
+    struct _CacheEntry *entry;
+    struct _CacheIndexRecord *record;
+
+    if (!cmng->persistent)
+        return;
+
+    // file is renamed or inode is reused
+    entry = g_hash_table_lookup (cmng->h_entries, GUINT_TO_POINTER (ino));
+    if (entry && g_strcmp0 (entry->fname, fname))
+        cache_mng_remove_file (cmng, ino);
+
+    g_hash_table_replace (cmng->h_fnames, GUINT_TO_POINTER (ino), g_strdup (fname));
+
+    record = g_hash_table_lookup (cmng->h_index, fname);
+    if (!record)
+        return;
+
+    // file is overwritten
+    if (is_new || g_hash_table_lookup (cmng->h_entries, GUINT_TO_POINTER (ino))) {
+        cache_mng_index_remove (cmng, fname);
+        return;
+    }
+
+    g_hash_table_steal (cmng->h_index, fname);
+
+    // adopt loaded data, ETag is checked by the first read
+    entry = cache_mng_entry_add (cmng, ino);
+    range_destroy (entry->avail_range);
+    entry->avail_range = record->range;
+    record->range = NULL;
+    entry->etag = record->etag;
+    record->etag = NULL;
+    range_foreach (entry->avail_range, cache_mng_touch_range_cb, entry);
+
+    LOG_debug (CMNG_LOG, INO_H"Loaded from persistent cache: %s, size: %"G_GUINT64_FORMAT,
+        INO_T (ino), fname, range_length (entry->avail_range));
+
+    cache_index_record_destroy (record);
 }
 /*}}}*/
 
@@ -393,19 +1930,28 @@ void cache_mng_store_file_buf (CacheMng *cmng, fuse_ino_t ino, size_t size, off_
 void cache_mng_remove_file (CacheMng *cmng, fuse_ino_t ino)
 {
     struct _CacheEntry *entry;
-    char path[PATH_MAX];
 
     entry = g_hash_table_lookup (cmng->h_entries, GUINT_TO_POINTER (ino));
     if (entry) {
         cmng->size -= range_length (entry->avail_range);
-        g_queue_delete_link (cmng->q_lru, entry->ll_lru);
-        g_hash_table_remove (cmng->h_entries, GUINT_TO_POINTER (ino));
-        cache_mng_file_name (cmng, path, sizeof (path), ino);
-        unlink (path);
+        cache_entry_drop_blocks (entry);
+        cache_mem_drop_range (cmng, entry, 0, G_MAXUINT64);
+        g_hash_table_steal (cmng->h_entries, GUINT_TO_POINTER (ino));
+
+        // the running disk operation may create the file again, it's removed once the operation is done
+        if (g_queue_is_empty (entry->q_io)) {
+            unlink (entry->path);
+            cache_entry_destroy (entry);
+        } else
+            entry->removed = TRUE;
+
         LOG_debug (CMNG_LOG, INO_H"Entry is removed", INO_T (ino));
     } else {
         LOG_debug (CMNG_LOG, INO_H"Entry not found", INO_T (ino));
     }
+
+    // the path is set again when the file is opened
+    g_hash_table_remove (cmng->h_fnames, GUINT_TO_POINTER (ino));
 }
 /*}}}*/
 
@@ -427,4 +1973,12 @@ void cache_mng_get_stats (CacheMng *cmng, guint32 *entries_num, guint64 *total_s
         *total_size = *total_size + range_length (entry->avail_range);
     }
 
-}/*}}}*/
+}
+
+void cache_mng_get_policy_stats (CacheMng *cmng, const gchar **policy, guint64 *ghost_hits, guint64 *ghost_miss)
+{
+    *policy = cmng->policy->name;
+    *ghost_hits = cmng->ghost_hits;
+    *ghost_miss = cmng->ghost_miss;
+}
+/*}}}*/
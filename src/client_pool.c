@@ -24,7 +24,49 @@ struct _ClientPool {
     struct event_base *evbase;
     struct evdns_base *dns_base;
     GList *l_clients; // the list of PoolClient (HTTPClient or HTTPConnection)
-    GQueue *q_requests; // the queue of awaiting requests
+    // stack of idle PoolClient: the most recently released client is at the head,
+    // so busy pools keep reusing warm connections and the tail expires first
+    GQueue *q_idle;
+
+    // awaiting requests, one queue per priority class,
+    // queues are served in proportion to their weights (stride scheduling):
+    // the non-empty queue with the smallest pass goes first and its pass grows by 1 / weight
+    GQueue *q_requests[CLIENT_POOL_PRIO_COUNT];
+    gdouble pass[CLIENT_POOL_PRIO_COUNT];
+    gdouble vtime; // pass of the last served request
+    guint requests_count; // number of requests in all queues
+    ClientPoolPriority default_prio; // used by client_pool_get_client ()
+
+    // idle clients of lenders are used by foreground requests of this pool,
+    // idle clients of this pool are used by foreground requests of borrowers
+    GList *l_lenders;
+    GList *l_borrowers;
+
+    // used to add clients on demand
+    ClientPool_client_create client_create;
+    ClientPool_client_destroy client_destroy;
+    ClientPool_client_set_on_released_cb client_set_on_released_cb;
+    ClientPool_client_check_rediness client_check_rediness;
+    ClientPool_client_get_stats_info_caption client_get_stats_info_caption;
+    ClientPool_client_get_stats_info_data client_get_stats_info_data;
+
+    // the pool grows from min_clients to max_clients while requests are waiting,
+    // clients above min_clients are destroyed once they are idle for idle_timeout seconds
+    guint client_count;
+    guint min_clients;
+    guint max_clients;
+    guint idle_timeout;
+    struct event *ev_idle;
+
+    // AIMD congestion window: the number of requests allowed to run in parallel,
+    // halved on throttling responses and timeouts, grows by one per window of successful requests
+    gdouble cwnd;
+    time_t last_decrease;
+
+    // request time (msec): its moving average and the baseline it is compared with,
+    // the pool doesn't grow while the average is well above the baseline
+    gdouble latency_avg;
+    gdouble latency_base;
 };
 
 typedef struct {
@@ -34,6 +76,8 @@ typedef struct {
     ClientPool_client_get_stats_info_caption client_get_stats_info_caption;
     ClientPool_client_get_stats_info_data client_get_stats_info_data;
     gpointer client;
+    time_t idle_since; // time when the client finished the last request
+    GList *idle_link; // link in q_idle, NULL if the client is busy
 } PoolClient;
 
 typedef struct {
@@ -42,9 +86,72 @@ typedef struct {
 } RequestData;
 
 #define POOL "pool"
+// how often idle clients are checked (seconds)
+#define POOL_IDLE_CHECK_INTERVAL 1
+// relative share of clients each priority class gets while all of them are waiting
+static const guint prio_weights[CLIENT_POOL_PRIO_COUNT] = { 8, 4, 2, 1 };
+// the window is decreased at most once per this interval (seconds),
+// so a burst of throttled responses counts as a single congestion event
+#define POOL_CWND_DECREASE_INTERVAL 1
+// the part of the awaiting queue (1 / N) which background requests can't take
+// in pools serving foreground requests, so reads and lookups are not rejected
+#define POOL_FOREGROUND_RESERVE 4
+// weight of a new sample in the average request time (1 / N)
+#define POOL_LATENCY_AVG_WEIGHT 8
+// the baseline follows a higher average slowly (1 / N of the difference per request),
+// so it adapts to a server which became slower for good
+#define POOL_LATENCY_BASE_WEIGHT 256
+// new clients are not added while the average exceeds the baseline this many times
+#define POOL_LATENCY_GROWTH_LIMIT 2
+// differences below this request time (msec) are noise
+#define POOL_LATENCY_MIN 10
 
 static void client_pool_on_client_released (gpointer client, gpointer ctx);
 
+// puts the client on top of the idle stack
+static void client_pool_push_idle (ClientPool *pool, PoolClient *pc)
+{
+    if (pc->idle_link)
+        return;
+
+    pc->idle_since = time (NULL);
+    g_queue_push_head (pool->q_idle, pc);
+    pc->idle_link = g_queue_peek_head_link (pool->q_idle);
+}
+
+// removes the client from the idle stack
+static void client_pool_remove_idle (ClientPool *pool, PoolClient *pc)
+{
+    if (!pc->idle_link)
+        return;
+
+    g_queue_delete_link (pool->q_idle, pc->idle_link);
+    pc->idle_link = NULL;
+}
+
+// creates a new client and adds it to the pool
+static PoolClient *client_pool_add_client (ClientPool *pool)
+{
+    PoolClient *pc;
+
+    pc = g_new0 (PoolClient, 1);
+    pc->pool = pool;
+    pc->client = pool->client_create (pool->app);
+    pc->client_check_rediness = pool->client_check_rediness;
+    pc->client_destroy = pool->client_destroy;
+    pc->client_get_stats_info_caption = pool->client_get_stats_info_caption;
+    pc->client_get_stats_info_data = pool->client_get_stats_info_data;
+    pc->idle_link = NULL;
+    // add to the list
+    pool->l_clients = g_list_append (pool->l_clients, pc);
+    pool->client_count++;
+    client_pool_push_idle (pool, pc);
+    // add callback
+    pool->client_set_on_released_cb (pc->client, client_pool_on_client_released, pc);
+
+    return pc;
+}
+
 // creates connection pool object
 // create client_count clients
 // return NULL if error
@@ -60,7 +167,6 @@ ClientPool *client_pool_create (Application *app,
 {
     ClientPool *pool;
     gint i;
-    PoolClient *pc;
 
 
     pool = g_new0 (ClientPool, 1);
@@ -68,96 +174,354 @@ ClientPool *client_pool_create (Application *app,
     pool->evbase = application_get_evbase (app);
     pool->dns_base = application_get_dnsbase (app);
     pool->l_clients = NULL;
-    pool->q_requests = g_queue_new ();
-
-    for (i = 0; i < client_count; i++) {
-        pc = g_new0 (PoolClient, 1);
-        pc->pool = pool;
-        pc->client = client_create (app);
-        pc->client_check_rediness = client_check_rediness;
-        pc->client_destroy = client_destroy;
-        pc->client_get_stats_info_caption = client_get_stats_info_caption;
-        pc->client_get_stats_info_data = client_get_stats_info_data;
-        // add to the list
-        pool->l_clients = g_list_append (pool->l_clients, pc);
-        // add callback
-        client_set_on_released_cb (pc->client, client_pool_on_client_released, pc);
+    pool->q_idle = g_queue_new ();
+    for (i = 0; i < CLIENT_POOL_PRIO_COUNT; i++) {
+        pool->q_requests[i] = g_queue_new ();
+        pool->pass[i] = 0;
     }
+    pool->vtime = 0;
+    pool->requests_count = 0;
+    pool->default_prio = CLIENT_POOL_PRIO_READ;
+    pool->l_lenders = NULL;
+    pool->l_borrowers = NULL;
+    pool->client_create = client_create;
+    pool->client_destroy = client_destroy;
+    pool->client_set_on_released_cb = client_set_on_released_cb;
+    pool->client_check_rediness = client_check_rediness;
+    pool->client_get_stats_info_caption = client_get_stats_info_caption;
+    pool->client_get_stats_info_data = client_get_stats_info_data;
+    pool->client_count = 0;
+    pool->min_clients = pool->max_clients = MAX (client_count, 0);
+    pool->idle_timeout = 0;
+    pool->ev_idle = NULL;
+    pool->cwnd = MAX (pool->max_clients, 1);
+    pool->last_decrease = 0;
+    pool->latency_avg = 0;
+    pool->latency_base = 0;
+
+    for (i = 0; i < client_count; i++)
+        client_pool_add_client (pool);
 
     return pool;
 }
 
+// destroys clients above the minimal number which are idle for too long
+static void client_pool_on_idle_timer (G_GNUC_UNUSED evutil_socket_t fd, G_GNUC_UNUSED short flags, void *ctx)
+{
+    ClientPool *pool = (ClientPool *) ctx;
+    PoolClient *pc;
+    time_t now = time (NULL);
+
+    // the longest idle clients are at the bottom of the stack
+    while (pool->client_count > pool->min_clients && (pc = g_queue_peek_tail (pool->q_idle))) {
+        if (now >= pc->idle_since && (guint) (now - pc->idle_since) < pool->idle_timeout)
+            break;
+
+        client_pool_remove_idle (pool, pc);
+        pool->l_clients = g_list_remove (pool->l_clients, pc);
+        pool->client_count--;
+        pc->client_destroy (pc->client);
+        g_free (pc);
+
+        LOG_debug (POOL, "Idle client is closed, clients: %u", pool->client_count);
+    }
+}
+
+void client_pool_set_max_clients (ClientPool *pool, gint max_clients, guint idle_timeout)
+{
+    struct timeval tv;
+
+    pool->max_clients = MAX ((guint) MAX (max_clients, 0), pool->min_clients);
+    pool->idle_timeout = idle_timeout;
+    pool->cwnd = MAX (pool->max_clients, 1);
+
+    if (pool->ev_idle) {
+        event_free (pool->ev_idle);
+        pool->ev_idle = NULL;
+    }
+
+    if (pool->max_clients == pool->min_clients)
+        return;
+
+    pool->ev_idle = event_new (pool->evbase, -1, EV_PERSIST, client_pool_on_idle_timer, pool);
+    evutil_timerclear (&tv);
+    tv.tv_sec = POOL_IDLE_CHECK_INTERVAL;
+    event_add (pool->ev_idle, &tv);
+}
+
 void client_pool_destroy (ClientPool *pool)
 {
     GList *l;
     PoolClient *pc;
+    gint i;
 
-    if (pool->q_requests)
-        _queue_free_full (pool->q_requests, g_free);
+    if (pool->ev_idle)
+        event_free (pool->ev_idle);
+    for (i = 0; i < CLIENT_POOL_PRIO_COUNT; i++)
+        _queue_free_full (pool->q_requests[i], g_free);
+    for (l = g_list_first (pool->l_lenders); l; l = g_list_next (l)) {
+        ClientPool *lender = (ClientPool *) l->data;
+        lender->l_borrowers = g_list_remove (lender->l_borrowers, pool);
+    }
+    g_list_free (pool->l_lenders);
+    for (l = g_list_first (pool->l_borrowers); l; l = g_list_next (l)) {
+        ClientPool *borrower = (ClientPool *) l->data;
+        borrower->l_lenders = g_list_remove (borrower->l_lenders, pool);
+    }
+    g_list_free (pool->l_borrowers);
     for (l = g_list_first (pool->l_clients); l; l = g_list_next (l)) {
         pc = (PoolClient *) l->data;
         pc->client_destroy (pc->client);
         g_free (pc);
     }
     g_list_free (pool->l_clients);
+    g_queue_free (pool->q_idle);
 
     g_free (pool);
 }
 
-// callback executed when a client done with a request
-static void client_pool_on_client_released (gpointer client, gpointer ctx)
+// returns the number of clients executing requests
+static guint client_pool_get_busy_count (ClientPool *pool)
+{
+    return pool->client_count - g_queue_get_length (pool->q_idle);
+}
+
+// returns an existing client which is ready to execute a new request
+// returns NULL if all clients are busy or the congestion window is full
+static PoolClient *client_pool_get_idle_client (ClientPool *pool)
+{
+    if (client_pool_get_busy_count (pool) >= (guint) pool->cwnd)
+        return NULL;
+
+    return (PoolClient *) g_queue_peek_head (pool->q_idle);
+}
+
+// passes the client to the request,
+// the client goes back to the idle stack if the request didn't use it
+static void client_pool_run_request (PoolClient *pc, ClientPool_on_client_ready on_client_ready, gpointer ctx)
+{
+    client_pool_remove_idle (pc->pool, pc);
+    on_client_ready (pc->client, ctx);
+    if (!pc->idle_link && pc->client_check_rediness (pc->client))
+        client_pool_push_idle (pc->pool, pc);
+}
+
+// requests take much longer than before: the server or the network is saturated,
+// more parallel requests would only make each of them slower
+static gboolean client_pool_latency_is_rising (ClientPool *pool)
+{
+    return pool->latency_avg > MAX (pool->latency_base, POOL_LATENCY_MIN) * POOL_LATENCY_GROWTH_LIMIT;
+}
+
+// returns a client which is ready to execute a new request, adds a new one if all are busy
+// returns NULL if the pool can't grow or the congestion window is full
+static PoolClient *client_pool_get_ready_client (ClientPool *pool)
+{
+    PoolClient *pc;
+
+    pc = client_pool_get_idle_client (pool);
+    if (pc)
+        return pc;
+
+    // all clients are busy, add a new one instead of waiting
+    if (pool->client_count < pool->max_clients && client_pool_get_busy_count (pool) < (guint) pool->cwnd &&
+        !client_pool_latency_is_rising (pool)) {
+        pc = client_pool_add_client (pool);
+        LOG_debug (POOL, "all Pool's clients are busy, adding a new one, clients: %u", pool->client_count);
+        return pc;
+    }
+
+    return NULL;
+}
+
+// foreground requests may use idle clients of other pools
+static gboolean client_pool_prio_is_foreground (ClientPoolPriority prio)
+{
+    return prio == CLIENT_POOL_PRIO_METADATA || prio == CLIENT_POOL_PRIO_READ;
+}
+
+// removes the next request from the awaiting queues, returns NULL if there is none
+static RequestData *client_pool_pop_request (ClientPool *pool, gboolean foreground_only)
+{
+    gint i;
+    gint prio = -1;
+
+    for (i = 0; i < CLIENT_POOL_PRIO_COUNT; i++) {
+        if (g_queue_is_empty (pool->q_requests[i]))
+            continue;
+        if (foreground_only && !client_pool_prio_is_foreground (i))
+            continue;
+        if (prio < 0 || pool->pass[i] < pool->pass[prio])
+            prio = i;
+    }
+
+    if (prio < 0)
+        return NULL;
+
+    pool->vtime = pool->pass[prio];
+    pool->pass[prio] += 1.0 / prio_weights[prio];
+    pool->requests_count--;
+
+    return g_queue_pop_head (pool->q_requests[prio]);
+}
+
+// passes awaiting requests to ready clients while the congestion window allows,
+// idle clients which are left are lent to the foreground requests of borrowers
+static void client_pool_dispatch (ClientPool *pool)
 {
-    PoolClient *pc = (PoolClient *) ctx;
     RequestData *data;
+    PoolClient *pc;
+    GList *l;
 
-    // if we have a request pending
-    data = g_queue_pop_head (pc->pool->q_requests);
-    if (data) {
+    while (pool->requests_count && (pc = client_pool_get_ready_client (pool))) {
+        data = client_pool_pop_request (pool, FALSE);
         LOG_debug (POOL, "Retrieving client from the Pool: %p", data->ctx);
-        data->on_client_ready (client, data->ctx);
+        client_pool_run_request (pc, data->on_client_ready, data->ctx);
         g_free (data);
     }
+
+    for (l = g_list_first (pool->l_borrowers); l; l = g_list_next (l)) {
+        ClientPool *borrower = (ClientPool *) l->data;
+
+        while (borrower->requests_count && (pc = client_pool_get_idle_client (pool))) {
+            data = client_pool_pop_request (borrower, TRUE);
+            if (!data)
+                break;
+            LOG_debug (POOL, "Lending client to another Pool: %p", data->ctx);
+            client_pool_run_request (pc, data->on_client_ready, data->ctx);
+            g_free (data);
+        }
+    }
+}
+
+// callback executed when a client done with a request
+static void client_pool_on_client_released (G_GNUC_UNUSED gpointer client, gpointer ctx)
+{
+    PoolClient *pc = (PoolClient *) ctx;
+
+    client_pool_push_idle (pc->pool, pc);
+
+    // if we have a request pending
+    client_pool_dispatch (pc->pool);
+}
+
+// updates the average request time and its baseline
+static void client_pool_add_latency (ClientPool *pool, guint64 latency_ms)
+{
+    if (pool->latency_avg == 0)
+        pool->latency_avg = latency_ms;
+    else
+        pool->latency_avg += ((gdouble) latency_ms - pool->latency_avg) / POOL_LATENCY_AVG_WEIGHT;
+
+    if (pool->latency_base == 0 || pool->latency_avg < pool->latency_base)
+        pool->latency_base = pool->latency_avg;
+    else
+        pool->latency_base += (pool->latency_avg - pool->latency_base) / POOL_LATENCY_BASE_WEIGHT;
+}
+
+void client_pool_on_request_feedback (gpointer ctx, gboolean congested, guint64 latency_ms)
+{
+    PoolClient *pc = (PoolClient *) ctx;
+    ClientPool *pool = pc->pool;
+    time_t now;
+
+    if (congested) {
+        now = time (NULL);
+        if (now >= pool->last_decrease && now - pool->last_decrease < POOL_CWND_DECREASE_INTERVAL)
+            return;
+
+        pool->cwnd = MAX (pool->cwnd / 2, 1.0);
+        pool->last_decrease = now;
+
+        LOG_msg (POOL, "Server is throttling requests, reducing the number of parallel requests to %u",
+            (guint) pool->cwnd);
+    } else {
+        // failed requests don't tell how long the server takes to respond
+        client_pool_add_latency (pool, latency_ms);
+        if (pool->cwnd < pool->max_clients) {
+            pool->cwnd = MIN (pool->cwnd + 1.0 / pool->cwnd, (gdouble) pool->max_clients);
+            client_pool_dispatch (pool);
+        }
+    }
 }
 
 // add client's callback to the awaiting queue
 // return TRUE if added, FALSE if list is full
 gboolean client_pool_get_client (ClientPool *pool, ClientPool_on_client_ready on_client_ready, gpointer ctx)
 {
-    GList *l;
+    return client_pool_get_client_prio (pool, pool->default_prio, on_client_ready, ctx);
+}
+
+gboolean client_pool_get_client_prio (ClientPool *pool, ClientPoolPriority prio,
+    ClientPool_on_client_ready on_client_ready, gpointer ctx)
+{
     RequestData *data;
     PoolClient *pc;
+    GList *l;
+    guint max_requests;
+
+    max_requests = conf_get_uint (application_get_conf (pool->app), "pool.max_requests_per_pool");
+    if (!client_pool_prio_is_foreground (prio) && client_pool_prio_is_foreground (pool->default_prio))
+        max_requests -= max_requests / POOL_FOREGROUND_RESERVE;
 
     // check if the awaiting queue is full
-    if (g_queue_get_length (pool->q_requests) >= conf_get_uint (application_get_conf (pool->app), "pool.max_requests_per_pool")) {
+    if (pool->requests_count >= max_requests) {
         LOG_debug (POOL, "Pool's client awaiting queue is full !");
         return FALSE;
     }
 
-    // check if there is a client which is ready to execute a new request
-    for (l = g_list_first (pool->l_clients); l; l = g_list_next (l)) {
-        pc = (PoolClient *) l->data;
+    // requests which are already waiting go first
+    if (!pool->requests_count && (pc = client_pool_get_ready_client (pool))) {
+        client_pool_run_request (pc, on_client_ready, ctx);
+        return TRUE;
+    }
 
-        // check if client is ready
-        if (pc->client_check_rediness (pc->client)) {
-            on_client_ready (pc->client, ctx);
-            return TRUE;
+    // borrow an idle client of another pool
+    if (client_pool_prio_is_foreground (prio)) {
+        for (l = g_list_first (pool->l_lenders); l; l = g_list_next (l)) {
+            ClientPool *lender = (ClientPool *) l->data;
+
+            if (!lender->requests_count && (pc = client_pool_get_idle_client (lender))) {
+                LOG_debug (POOL, "Borrowing client from another Pool: %p", ctx);
+                client_pool_run_request (pc, on_client_ready, ctx);
+                return TRUE;
+            }
         }
     }
 
     LOG_debug (POOL, "all Pool's clients are busy, putting into queue: %p", ctx);
 
-    // add client to the end of queue
+    // add client to the end of queue,
+    // a queue which was empty doesn't get credit for the time it was idle
+    if (g_queue_is_empty (pool->q_requests[prio]))
+        pool->pass[prio] = MAX (pool->pass[prio], pool->vtime);
+
     data = g_new0 (RequestData, 1);
     data->on_client_ready = on_client_ready;
     data->ctx = ctx;
-    g_queue_push_tail (pool->q_requests, data);
+    g_queue_push_tail (pool->q_requests[prio], data);
+    pool->requests_count++;
 
     return TRUE;
 }
 
+void client_pool_set_default_prio (ClientPool *pool, ClientPoolPriority prio)
+{
+    pool->default_prio = prio;
+}
+
+void client_pool_add_lender (ClientPool *pool, ClientPool *lender)
+{
+    if (pool == lender || g_list_find (pool->l_lenders, lender))
+        return;
+
+    pool->l_lenders = g_list_append (pool->l_lenders, lender);
+    lender->l_borrowers = g_list_append (lender->l_borrowers, pool);
+}
+
 gint client_pool_get_client_count (ClientPool *pool)
 {
-    return g_list_length (pool->l_clients);
+    return pool->client_count;
 }
 
 // collects statistics information from clients
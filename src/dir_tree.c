@@ -85,6 +85,8 @@ struct _DirEntry {
     time_t access_time; // time when entry was accessed
 
     gchar *etag; // S3 md5
+    time_t meta_time; // time when size and ETag were received from the listing, 0 if unknown
+    gchar *open_etag; // ETag at the time of the previous open, kernel page cache holds this version
     gchar *version_id;
     gchar *content_type;
     time_t xattr_time; // time when XAttrs were updated
@@ -173,6 +175,8 @@ static void dir_entry_destroy (gpointer data)
         g_free (en->dir_cache);
     if (en->etag)
         g_free (en->etag);
+    if (en->open_etag)
+        g_free (en->open_etag);
     if (en->version_id)
         g_free (en->version_id);
     if (en->content_type)
@@ -240,6 +244,8 @@ static DirEntry *dir_tree_add_entry (DirTree *dtree, const gchar *basename, mode
     en->is_modified = FALSE;
     en->removed = FALSE;
     en->updated_time = 0;
+    en->meta_time = 0;
+    en->open_etag = NULL;
     en->access_time = time (NULL);
     en->xattr_time = 0;
 
@@ -335,6 +341,9 @@ static gboolean dir_tree_stop_update_on_remove_child_cb (gpointer key, gpointer
         // first remove item from the inode hash table !
         g_hash_table_remove (dtree->h_inodes, GUINT_TO_POINTER (en->ino));
 
+        // the kernel might still keep the entry
+        rfuse_inval_entry (application_get_rfuse (dtree->app), en->parent_ino, name);
+
         // now remove from parent's hash table, it will call destroy () fucntion
         if (en->type == DET_dir) {
             // XXX:
@@ -374,7 +383,7 @@ void dir_tree_stop_update (DirTree *dtree, fuse_ino_t parent_ino)
 }
 
 DirEntry *dir_tree_update_entry (DirTree *dtree, G_GNUC_UNUSED const gchar *path, DirEntryType type,
-    fuse_ino_t parent_ino, const gchar *entry_name, long long size, time_t last_modified)
+    fuse_ino_t parent_ino, const gchar *entry_name, long long size, time_t last_modified, const gchar *etag)
 {
     DirEntry *parent_en;
     DirEntry *en;
@@ -406,6 +415,20 @@ DirEntry *dir_tree_update_entry (DirTree *dtree, G_GNUC_UNUSED const gchar *path
             type, parent_ino, size, last_modified);
     }
 
+    // size and ETag come from the server, the first read may skip HEAD request
+    if (etag) {
+        gchar *new_etag = str_remove_quotes (g_strdup (etag));
+
+        // the object is changed by someone else, the kernel must not serve the old version
+        if (en->etag && strcmp (en->etag, new_etag))
+            rfuse_inval_inode (application_get_rfuse (dtree->app), en->ino);
+
+        if (en->etag)
+            g_free (en->etag);
+        en->etag = new_etag;
+        en->meta_time = time (NULL);
+    }
+
     LOG_debug (DIR_TREE_LOG, INO_H"Updating %s, size: %lld", INO_T (en->ino), entry_name, size);
 
     return en;
@@ -934,7 +957,7 @@ static void dir_tree_on_lookup_not_found_cb (HttpConnection *con, void *ctx, gbo
     }
 
     en = dir_tree_update_entry (op_data->dtree, parent_en->fullpath, DET_file,
-        op_data->parent_ino, op_data->name, size, last_modified);
+        op_data->parent_ino, op_data->name, size, last_modified, NULL);
 
     if (!en) {
         LOG_err (DIR_TREE_LOG, INO_H"Failed to create FileEntry parent ino: %"INO_FMT" !",
@@ -947,6 +970,8 @@ static void dir_tree_on_lookup_not_found_cb (HttpConnection *con, void *ctx, gbo
     }
 
     dir_tree_entry_update_xattrs (en, headers);
+    if (en->etag)
+        en->meta_time = time (NULL);
 
     op_data->lookup_cb (op_data->req, TRUE, en->ino, en->mode, en->size, en->ctime);
     g_free (op_data->name);
@@ -1025,6 +1050,45 @@ static void dir_tree_on_lookup_read (G_GNUC_UNUSED fuse_req_t req, gboolean succ
     g_free (op_data);
 }
 
+gboolean dir_tree_get_entry_meta (DirTree *dtree, fuse_ino_t ino, guint64 *size, const gchar **etag)
+{
+    DirEntry *en;
+    time_t max_time;
+    time_t t = time (NULL);
+
+    if (!conf_node_exists (application_get_conf (dtree->app), "filesystem.file_meta_max_time") ||
+        conf_get_boolean (application_get_conf (dtree->app), "s3.force_head_requests_on_lookup"))
+        return FALSE;
+    max_time = conf_get_uint (application_get_conf (dtree->app), "filesystem.file_meta_max_time");
+
+    en = g_hash_table_lookup (dtree->h_inodes, GUINT_TO_POINTER (ino));
+    if (!en || en->type != DET_file || en->removed || en->is_modified || !en->etag || !en->meta_time)
+        return FALSE;
+
+    if (t < en->meta_time || t - en->meta_time >= max_time)
+        return FALSE;
+
+    *size = en->size;
+    *etag = en->etag;
+
+    return TRUE;
+}
+
+void dir_tree_set_entry_meta (DirTree *dtree, fuse_ino_t ino, guint64 size, const gchar *etag)
+{
+    DirEntry *en;
+
+    en = g_hash_table_lookup (dtree->h_inodes, GUINT_TO_POINTER (ino));
+    if (!en || en->type != DET_file || en->is_modified)
+        return;
+
+    en->size = size;
+    if (en->etag)
+        g_free (en->etag);
+    en->etag = str_remove_quotes (g_strdup (etag));
+    en->meta_time = time (NULL);
+}
+
 void dir_tree_set_entry_exist (DirTree *dtree, fuse_ino_t ino)
 {
     DirEntry *en;
@@ -1363,6 +1427,19 @@ void dir_tree_file_open (DirTree *dtree, fuse_ino_t ino, struct fuse_file_info *
     fop = fileio_create (dtree->app, en->fullpath, en->ino, FALSE);
     fi->fh = convert_ptr_to_fh (fop);
 
+    // the object is not changed since the previous open, pages cached by the kernel are still valid
+    if (en->etag && en->open_etag && !en->is_modified && !strcmp (en->etag, en->open_etag))
+        fi->keep_cache = 1;
+    if (en->open_etag)
+        g_free (en->open_etag);
+    en->open_etag = en->etag ? g_strdup (en->etag) : NULL;
+
+    // small files are downloaded at once, the first read usually finds data in the cache
+    if (conf_node_exists (application_get_conf (dtree->app), "s3.open_prefetch_size") &&
+        en->size > 0 && (guint64) en->size < conf_get_uint (application_get_conf (dtree->app), "s3.open_prefetch_size") &&
+        (fi->flags & O_ACCMODE) != O_WRONLY && !(fi->flags & O_TRUNC))
+        fileio_prefetch (fop, en->size);
+
     LOG_debug (DIR_TREE_LOG, INO_FOP_H"dir_tree_open", INO_T (en->ino), (void *)fop);
 
     file_open_cb (req, TRUE, fi);
@@ -1398,6 +1475,7 @@ void dir_tree_file_release (DirTree *dtree, fuse_ino_t ino, G_GNUC_UNUSED struct
 
 typedef struct {
     DirTree_file_read_cb file_read_cb;
+    DirTree_file_read_fd_cb file_read_fd_cb;
     fuse_req_t req;
     size_t size;
     fuse_ino_t ino;
@@ -1420,10 +1498,21 @@ static void dir_tree_on_buffer_read_cb (gpointer ctx, gboolean success, char *bu
     g_free (op_data);
 }
 
+// executed in a worker thread
+static void dir_tree_on_fd_read_cb (gpointer ctx, int fd, off_t off, size_t size)
+{
+    FileReadOpData *op_data = (FileReadOpData *)ctx;
+
+    LOG_debug (DIR_TREE_LOG, INO_FROP_H"file READ_cb, fd: %d", INO_T (op_data->ino), (void *)op_data, fd);
+
+    op_data->file_read_fd_cb (op_data->req, fd, off, size);
+    g_free (op_data);
+}
+
 // read file starting at off position, size length
 void dir_tree_file_read (DirTree *dtree, fuse_ino_t ino,
     size_t size, off_t off,
-    DirTree_file_read_cb file_read_cb, fuse_req_t req,
+    DirTree_file_read_cb file_read_cb, DirTree_file_read_fd_cb file_read_fd_cb, fuse_req_t req,
     G_GNUC_UNUSED struct fuse_file_info *fi)
 {
     DirEntry *en;
@@ -1446,11 +1535,13 @@ void dir_tree_file_read (DirTree *dtree, fuse_ino_t ino,
 
     op_data = g_new0 (FileReadOpData, 1);
     op_data->file_read_cb = file_read_cb;
+    op_data->file_read_fd_cb = file_read_fd_cb;
     op_data->req = req;
     op_data->size = size;
     op_data->ino = ino;
 
-    fileio_read_buffer (fop, size, off, ino, dir_tree_on_buffer_read_cb, op_data);
+    fileio_read_buffer (fop, size, off, ino, dir_tree_on_buffer_read_cb,
+        file_read_fd_cb ? dir_tree_on_fd_read_cb : NULL, op_data);
 }
 /*}}}*/
 
@@ -1525,6 +1616,12 @@ void dir_tree_file_write (DirTree *dtree, fuse_ino_t ino,
 
     // set updated time for write op
     en->updated_time = time (NULL);
+    // listing does not describe the object anymore
+    en->meta_time = 0;
+    if (en->open_etag) {
+        g_free (en->open_etag);
+        en->open_etag = NULL;
+    }
 
     LOG_debug (DIR_TREE_LOG, INO_FOP_H"write inode, size: %zu, off: %"OFF_FMT, INO_T (ino), (void *)fop, size, off);
 
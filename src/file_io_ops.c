@@ -20,6 +20,8 @@
 #include "cache_mng.h"
 #include "utils.h"
 #include "dir_tree.h"
+#include "worker_pool.h"
+#include "rfuse.h"
 
 /*{{{ struct */
 struct _FileIO {
@@ -36,11 +38,28 @@ struct _FileIO {
     gchar *uploadid;
     guint part_number;
     GList *l_parts; // list of FileIOPart
-    MD5_CTX md5;
+    guint parts_in_flight; // number of parts which are being uploaded
+    GQueue *q_parts_waiting; // parts waiting for multipart upload ID
+    GQueue *q_write_waiting; // write calls waiting for a free slot
+    gboolean upload_failed;
+    gboolean release_pending; // file is released, but parts are still in flight
 
     // read
     gboolean head_req_sent;
+    gboolean head_in_flight; // HEAD request is sent by one of the reads
     guint64 file_size;
+
+    // readahead
+    guint64 last_read_end; // offset right after the previous read request
+    guint seq_reads; // number of consecutive sequential read requests
+    guint64 readahead_off; // data up to this offset is cached or requested
+    guint readahead_count; // number of readahead requests in flight
+    GList *l_readahead; // list of FileReadAhead in flight
+
+    // prefetch on open
+    struct _FileReadAhead *prefetch; // whole object request in flight, NULL if not sent
+
+    GList *l_head_reads; // concurrent first reads waiting for HEAD or prefetch response, list of FileReadData
 };
 
 typedef struct {
@@ -49,10 +68,87 @@ typedef struct {
     gchar *sha256;
     gchar *md5b;
 } FileIOPart;
+
+// part data which is handed off to the write pool
+typedef struct {
+    FileIO *fop;
+    FileIOPart *part;
+    struct evbuffer *buf;
+} FileIOPartUpload;
 /*}}}*/
 
 #define FIO_LOG "fio"
 
+// number of sequential reads required before readahead kicks in
+#define FIO_READAHEAD_SEQ_READS 2
+// reads which start this close to the end of the previous one are considered sequential,
+// the kernel sends async reads of a sequential reader out of order
+#define FIO_READAHEAD_REORDER_WINDOW (1024 * 1024)
+// response chunks are collected up to this size before they are stored into the cache
+#define FIO_CACHE_STORE_SIZE (1024 * 1024)
+
+// collects small response chunks into large cache writes
+typedef struct {
+    struct evbuffer *buf; // data which is not stored yet, NULL if nothing is received
+    guint64 off; // offset of "buf" in the file
+} FileCacheWriter;
+
+typedef struct _FileReadAhead {
+    Application *app;
+    FileIO *fop; // set to NULL if FileIO is destroyed before request is finished
+    gchar *fname;
+    fuse_ino_t ino;
+    guint64 off;
+    guint64 size;
+    gboolean success; // data is stored into the cache
+    gboolean stream_failed; // response belongs to a different object version
+    FileCacheWriter writer;
+} FileReadAhead;
+
+/*{{{ cache writer */
+// moves collected data into the cache
+static void fileio_cache_writer_flush (FileCacheWriter *writer, Application *app, fuse_ino_t ino)
+{
+    size_t len;
+
+    if (!writer->buf || !(len = evbuffer_get_length (writer->buf)))
+        return;
+
+    cache_mng_store_file_evbuf (application_get_cache_mng (app), ino, writer->off, writer->buf, NULL, NULL);
+    writer->off += len;
+}
+
+static void fileio_cache_writer_add (FileCacheWriter *writer, Application *app, fuse_ino_t ino,
+    struct evbuffer *chunk, guint64 off)
+{
+    if (!writer->buf)
+        writer->buf = evbuffer_new ();
+
+    if (evbuffer_get_length (writer->buf) && writer->off + evbuffer_get_length (writer->buf) != off)
+        fileio_cache_writer_flush (writer, app, ino);
+    if (!evbuffer_get_length (writer->buf))
+        writer->off = off;
+
+    evbuffer_add_buffer (writer->buf, chunk);
+    if (evbuffer_get_length (writer->buf) >= FIO_CACHE_STORE_SIZE)
+        fileio_cache_writer_flush (writer, app, ino);
+}
+
+// drops collected data, a retried request starts over
+static void fileio_cache_writer_reset (FileCacheWriter *writer)
+{
+    if (writer->buf)
+        evbuffer_drain (writer->buf, evbuffer_get_length (writer->buf));
+}
+
+static void fileio_cache_writer_free (FileCacheWriter *writer)
+{
+    if (writer->buf)
+        evbuffer_free (writer->buf);
+    writer->buf = NULL;
+}
+/*}}}*/
+
 /*{{{ create / destroy */
 
 FileIO *fileio_create (Application *app, const gchar *fname, fuse_ino_t ino, gboolean assume_new)
@@ -67,12 +163,27 @@ FileIO *fileio_create (Application *app, const gchar *fname, fuse_ino_t ino, gbo
     fop->content_type = NULL;
     fop->file_size = 0;
     fop->head_req_sent = FALSE;
+    fop->head_in_flight = FALSE;
     fop->multipart_initiated = FALSE;
     fop->uploadid = NULL;
     fop->l_parts = NULL;
+    fop->part_number = 1;
+    fop->parts_in_flight = 0;
+    fop->q_parts_waiting = g_queue_new ();
+    fop->q_write_waiting = g_queue_new ();
+    fop->upload_failed = FALSE;
+    fop->release_pending = FALSE;
     fop->ino = ino;
     fop->assume_new = assume_new;
-    MD5_Init (&fop->md5);
+    fop->last_read_end = 0;
+    fop->seq_reads = 0;
+    fop->readahead_off = 0;
+    fop->readahead_count = 0;
+    fop->l_readahead = NULL;
+    fop->prefetch = NULL;
+    fop->l_head_reads = NULL;
+
+    cache_mng_set_file_path (application_get_cache_mng (app), ino, fop->fname, assume_new);
 
     return fop;
 }
@@ -89,6 +200,18 @@ void fileio_destroy (FileIO *fop)
         g_free (part);
     }
     g_list_free(fop->l_parts);
+    g_queue_free (fop->q_parts_waiting);
+    g_queue_free (fop->q_write_waiting);
+
+    // readahead requests are still in flight, detach them
+    for (l = g_list_first (fop->l_readahead); l; l = g_list_next (l)) {
+        FileReadAhead *ra = (FileReadAhead *) l->data;
+        ra->fop = NULL;
+    }
+    g_list_free (fop->l_readahead);
+    if (fop->prefetch)
+        fop->prefetch->fop = NULL;
+
     evbuffer_free (fop->write_buf);
     g_free (fop->fname);
     if (fop->content_type)
@@ -99,6 +222,63 @@ void fileio_destroy (FileIO *fop)
 }
 /*}}}*/
 
+/*{{{ parts */
+
+// moves the content of the write buffer into a new part
+static FileIOPartUpload *fileio_part_upload_create (FileIO *fop)
+{
+    FileIOPartUpload *upload;
+
+    upload = g_new0 (FileIOPartUpload, 1);
+    upload->fop = fop;
+    upload->buf = evbuffer_new ();
+    evbuffer_add_buffer (upload->buf, fop->write_buf);
+
+    // add part information to the list
+    upload->part = g_new0 (FileIOPart, 1);
+    upload->part->part_number = fop->part_number;
+    fop->l_parts = g_list_append (fop->l_parts, upload->part);
+
+    // increase part number
+    fop->part_number++;
+    // XXX: check that part_number does not exceeds 10000
+
+    return upload;
+}
+
+static void fileio_part_upload_destroy (FileIOPartUpload *upload)
+{
+    evbuffer_free (upload->buf);
+    g_free (upload);
+}
+
+// executed in a worker thread
+static void fileio_part_hash_task_cb (gpointer ctx)
+{
+    FileIOPartUpload *upload = (FileIOPartUpload *) ctx;
+    size_t buf_len;
+    const gchar *buf;
+
+    buf_len = evbuffer_get_length (upload->buf);
+    buf = (const gchar *) evbuffer_pullup (upload->buf, buf_len);
+
+    get_md5_sum (buf, buf_len, &upload->part->md5str, &upload->part->md5b);
+    upload->part->sha256 = sha256_base16 (buf, buf_len);
+}
+
+// calculates MD5 and SHA256 of the part without blocking the event loop,
+// on_hashed_cb is called in the event loop thread
+static void fileio_part_hash (FileIOPartUpload *upload, WorkerPool_on_task_done_cb on_hashed_cb)
+{
+    if (!worker_pool_push (application_get_worker_pool (upload->fop->app),
+        fileio_part_hash_task_cb, on_hashed_cb, upload)) {
+        LOG_err (FIO_LOG, INO_H"Failed to queue hashing task, hashing in place !", INO_T (upload->fop->ino));
+        fileio_part_hash_task_cb (upload);
+        on_hashed_cb (upload);
+    }
+}
+/*}}}*/
+
 /*{{{ fileio_release*/
 
 static void fileio_release_update_headers (FileIO *fop)
@@ -108,6 +288,67 @@ static void fileio_release_update_headers (FileIO *fop)
 }
 /*}}}*/
 
+/*{{{ Abort Multipart Upload */
+// uploaded parts are removed from the server
+static void fileio_release_on_abort_cb (HttpConnection *con, void *ctx, gboolean success,
+    G_GNUC_UNUSED const gchar *buf, G_GNUC_UNUSED size_t buf_len,
+    G_GNUC_UNUSED struct evkeyvalq *headers)
+{
+    FileIO *fop = (FileIO *) ctx;
+
+    http_connection_release (con);
+
+    if (!success)
+        LOG_err (FIO_LOG, INO_CON_H"Failed to abort Multipart Upload !", INO_T (fop->ino), (void *)con);
+    else
+        LOG_debug (FIO_LOG, INO_CON_H"Multipart Upload is aborted", INO_T (fop->ino), (void *)con);
+
+    fileio_destroy (fop);
+}
+
+// got HttpConnection object
+static void fileio_release_on_abort_con_cb (gpointer client, gpointer ctx)
+{
+    HttpConnection *con = (HttpConnection *) client;
+    FileIO *fop = (FileIO *) ctx;
+    gchar *path;
+    gboolean res;
+
+    http_connection_acquire (con);
+
+    path = g_strdup_printf ("%s?uploadId=%s", fop->fname, fop->uploadid);
+    res = http_connection_make_request (con,
+        path, "DELETE", NULL, TRUE, NULL,
+        fileio_release_on_abort_cb,
+        fop
+    );
+    g_free (path);
+
+    if (!res) {
+        LOG_err (FIO_LOG, INO_CON_H"Failed to create HTTP request !", INO_T (fop->ino), (void *)con);
+        http_connection_release (con);
+        fileio_destroy (fop);
+        return;
+    }
+}
+
+// upload failed, do not leave already uploaded parts on the server
+static void fileio_release_abort_multipart (FileIO *fop)
+{
+    if (!fop->uploadid) {
+        fileio_destroy (fop);
+        return;
+    }
+
+    if (!client_pool_get_client (application_get_write_client_pool (fop->app),
+        fileio_release_on_abort_con_cb, fop)) {
+        LOG_err (FIO_LOG, INO_H"Failed to get HTTP client !", INO_T (fop->ino));
+        fileio_destroy (fop);
+        return;
+    }
+}
+/*}}}*/
+
 /*{{{ Complete Multipart Upload */
 // multipart is sent
 static void fileio_release_on_complete_cb (HttpConnection *con, void *ctx, gboolean success,
@@ -210,13 +451,15 @@ static void fileio_release_on_part_sent_cb (HttpConnection *con, void *ctx, gboo
     G_GNUC_UNUSED const gchar *buf, G_GNUC_UNUSED size_t buf_len,
     G_GNUC_UNUSED struct evkeyvalq *headers)
 {
-    FileIO *fop = (FileIO *) ctx;
+    FileIOPartUpload *upload = (FileIOPartUpload *) ctx;
+    FileIO *fop = upload->fop;
 
     http_connection_release (con);
+    fileio_part_upload_destroy (upload);
 
     if (!success) {
         LOG_err (FIO_LOG, INO_CON_H"Failed to send buffer to server !", INO_T (fop->ino), (void *)con);
-        fileio_destroy (fop);
+        fileio_release_abort_multipart (fop);
         return;
     }
 
@@ -235,43 +478,25 @@ static void fileio_release_on_part_sent_cb (HttpConnection *con, void *ctx, gboo
 static void fileio_release_on_part_con_cb (gpointer client, gpointer ctx)
 {
     HttpConnection *con = (HttpConnection *) client;
-    FileIO *fop = (FileIO *) ctx;
+    FileIOPartUpload *upload = (FileIOPartUpload *) ctx;
+    FileIO *fop = upload->fop;
     gchar *path;
     gboolean res;
-    FileIOPart *part;
-    size_t buf_len;
-    const gchar *buf;
-
-    LOG_debug (FIO_LOG, INO_CON_H"Releasing fop. Size: %zu", INO_T (fop->ino), (void *)con, evbuffer_get_length (fop->write_buf));
-
-    // add part information to the list
-    part = g_new0 (FileIOPart, 1);
-    part->part_number = fop->part_number;
-    buf_len = evbuffer_get_length (fop->write_buf);
-    buf = (const gchar *)evbuffer_pullup (fop->write_buf, buf_len);
-
-    // XXX: move to separate thread
-    // 1. calculate MD5 of a part.
-    get_md5_sum (buf, buf_len, &part->md5str, &part->md5b);
-    part->sha256 = sha256_base16(buf, buf_len); 
 
-    // 2. calculate MD5 of multiple message blocks
-    MD5_Update (&fop->md5, buf, buf_len);
-
-    fop->l_parts = g_list_append (fop->l_parts, part);
+    LOG_debug (FIO_LOG, INO_CON_H"Releasing fop. Size: %zu", INO_T (fop->ino), (void *)con, evbuffer_get_length (upload->buf));
 
     // if this is a multipart
     if (fop->multipart_initiated) {
 
         if (!fop->uploadid) {
             LOG_err (FIO_LOG, INO_CON_H"UploadID is not set, aborting operation !", INO_T (fop->ino), (void *)con);
+            fileio_part_upload_destroy (upload);
             fileio_destroy (fop);
             return;
         }
 
         path = g_strdup_printf ("%s?partNumber=%u&uploadId=%s",
-            fop->fname, fop->part_number, fop->uploadid);
-        fop->part_number++;
+            fop->fname, upload->part->part_number, fop->uploadid);
 
     } else {
         path = g_strdup (fop->fname);
@@ -279,7 +504,8 @@ static void fileio_release_on_part_con_cb (gpointer client, gpointer ctx)
 
 #ifdef MAGIC_ENABLED
     // guess MIME type
-    const gchar *mime_type = magic_buffer (application_get_magic_ctx (fop->app), buf, buf_len);
+    const gchar *mime_type = magic_buffer (application_get_magic_ctx (fop->app),
+        evbuffer_pullup (upload->buf, -1), evbuffer_get_length (upload->buf));
     if (mime_type) {
         LOG_debug (FIO_LOG, "Guessed MIME type of %s as %s", path, mime_type);
         fop->content_type = g_strdup (mime_type);
@@ -291,8 +517,8 @@ static void fileio_release_on_part_con_cb (gpointer client, gpointer ctx)
     http_connection_acquire (con);
 
     // add output headers
-    http_connection_add_output_header (con, "Content-MD5", part->md5b);
-    http_connection_add_output_header (con, "x-amz-content-sha256", part->sha256);
+    http_connection_add_output_header (con, "Content-MD5", upload->part->md5b);
+    http_connection_add_output_header (con, "x-amz-content-sha256", upload->part->sha256);
 
     if (fop->content_type)
         http_connection_add_output_header (con, "Content-Type", fop->content_type);
@@ -313,16 +539,34 @@ static void fileio_release_on_part_con_cb (gpointer client, gpointer ctx)
     }
 
     res = http_connection_make_request (con,
-        path, "PUT", fop->write_buf, TRUE, NULL,
+        path, "PUT", upload->buf, TRUE, NULL,
         fileio_release_on_part_sent_cb,
-        fop
+        upload
     );
     g_free (path);
 
     if (!res) {
         LOG_err (FIO_LOG, INO_CON_H"Failed to create HTTP request !", INO_T (fop->ino), (void *)con);
         http_connection_release (con);
-        fileio_destroy (fop);
+        fileio_part_upload_destroy (upload);
+        // uploaded parts are removed from the server
+        fileio_release_abort_multipart (fop);
+        return;
+    }
+}
+
+// the last part is hashed
+static void fileio_release_on_part_hashed_cb (gpointer ctx)
+{
+    FileIOPartUpload *upload = (FileIOPartUpload *) ctx;
+    FileIO *fop = upload->fop;
+
+    if (!client_pool_get_client (application_get_write_client_pool (fop->app),
+        fileio_release_on_part_con_cb, upload)) {
+        LOG_err (FIO_LOG, INO_H"Failed to get HTTP client !", INO_T (fop->ino));
+        fileio_part_upload_destroy (upload);
+        // uploaded parts are removed from the server
+        fileio_release_abort_multipart (fop);
         return;
     }
 }
@@ -331,15 +575,23 @@ static void fileio_release_on_part_con_cb (gpointer client, gpointer ctx)
 // file is released, finish all operations
 void fileio_release (FileIO *fop)
 {
+    // wait until all parts are uploaded
+    if (fop->parts_in_flight) {
+        LOG_debug (FIO_LOG, INO_H"Waiting for %u parts to upload", INO_T (fop->ino), fop->parts_in_flight);
+        fop->release_pending = TRUE;
+        return;
+    }
+
+    if (fop->upload_failed) {
+        LOG_err (FIO_LOG, INO_H"Failed to upload file !", INO_T (fop->ino));
+        fileio_release_abort_multipart (fop);
+        return;
+    }
+
     // if write buffer has some data left - send it to the server
     // or an empty file was created
     if (evbuffer_get_length (fop->write_buf) || fop->assume_new) {
-        if (!client_pool_get_client (application_get_write_client_pool (fop->app),
-            fileio_release_on_part_con_cb, fop)) {
-            LOG_err (FIO_LOG, INO_H"Failed to get HTTP client !", INO_T (fop->ino));
-            fileio_destroy (fop);
-            return;
-        }
+        fileio_part_hash (fileio_part_upload_create (fop), fileio_release_on_part_hashed_cb);
     } else {
         // if it's a multi part upload - Complete Multipart Upload
         if (fop->multipart_initiated) {
@@ -363,6 +615,55 @@ typedef struct {
     gpointer ctx;
 } FileWriteData;
 
+static void fileio_write_send_part (FileIOPartUpload *upload);
+
+// maximum number of parts of a single file uploaded concurrently
+static guint fileio_write_get_max_parts (FileIO *fop)
+{
+    guint max_parts = 1;
+
+    if (conf_node_exists (application_get_conf (fop->app), "s3.upload_parts"))
+        max_parts = conf_get_uint (application_get_conf (fop->app), "s3.upload_parts");
+
+    return max_parts ? max_parts : 1;
+}
+
+// acknowledge delayed writes, as long as the in-flight budget allows it
+static void fileio_write_resume_writes (FileIO *fop)
+{
+    FileWriteData *wdata;
+
+    while ((fop->upload_failed || fop->parts_in_flight < fileio_write_get_max_parts (fop)) &&
+        (wdata = g_queue_pop_head (fop->q_write_waiting))) {
+
+        if (fop->upload_failed)
+            wdata->on_buffer_written_cb (fop, wdata->ctx, FALSE, 0);
+        else
+            wdata->on_buffer_written_cb (fop, wdata->ctx, TRUE, wdata->buf_size);
+        g_free (wdata);
+    }
+}
+
+// part upload is finished (or failed)
+static void fileio_write_on_part_done (FileIOPartUpload *upload, gboolean success)
+{
+    FileIO *fop = upload->fop;
+
+    fileio_part_upload_destroy (upload);
+
+    if (!success)
+        fop->upload_failed = TRUE;
+    fop->parts_in_flight--;
+
+    fileio_write_resume_writes (fop);
+
+    // file was released while parts were uploading
+    if (!fop->parts_in_flight && fop->release_pending) {
+        fop->release_pending = FALSE;
+        fileio_release (fop);
+    }
+}
+
 /*{{{ send part */
 
 // buffer is sent
@@ -370,97 +671,88 @@ static void fileio_write_on_send_cb (HttpConnection *con, void *ctx, gboolean su
     G_GNUC_UNUSED const gchar *buf, G_GNUC_UNUSED size_t buf_len,
     G_GNUC_UNUSED struct evkeyvalq *headers)
 {
-    FileWriteData *wdata = (FileWriteData *) ctx;
+    FileIOPartUpload *upload = (FileIOPartUpload *) ctx;
 
     http_connection_release (con);
 
     if (!success) {
-        LOG_err (FIO_LOG, INO_CON_H"Failed to send buffer to server !", INO_T (wdata->ino), (void *)con);
-        wdata->on_buffer_written_cb (wdata->fop, wdata->ctx, FALSE, 0);
-        g_free (wdata);
+        LOG_err (FIO_LOG, INO_CON_H"Failed to send part %u to server !", INO_T (upload->fop->ino), (void *)con, upload->part->part_number);
+        fileio_write_on_part_done (upload, FALSE);
         return;
     }
 
-    // empty part buffer
-    evbuffer_drain (wdata->fop->write_buf, -1);
+    LOG_debug (FIO_LOG, INO_CON_H"Part %u is sent", INO_T (upload->fop->ino), (void *)con, upload->part->part_number);
 
     // done sending part
-    wdata->on_buffer_written_cb (wdata->fop, wdata->ctx, TRUE, wdata->buf_size);
-    g_free (wdata);
+    fileio_write_on_part_done (upload, TRUE);
 }
 
 // got HttpConnection object
 static void fileio_write_on_send_con_cb (gpointer client, gpointer ctx)
 {
     HttpConnection *con = (HttpConnection *) client;
-    FileWriteData *wdata = (FileWriteData *) ctx;
+    FileIOPartUpload *upload = (FileIOPartUpload *) ctx;
     gchar *path;
     gboolean res;
-    FileIOPart *part;
-    size_t buf_len;
-    const gchar *buf;
 
     http_connection_acquire (con);
 
-    // add part information to the list
-    part = g_new0 (FileIOPart, 1);
-    part->part_number = wdata->fop->part_number;
-    buf_len = evbuffer_get_length (wdata->fop->write_buf);
-    buf = (const gchar *) evbuffer_pullup (wdata->fop->write_buf, buf_len);
-
-    // XXX: move to separate thread
-    // 1. calculate MD5 of a part.
-    get_md5_sum (buf, buf_len, &part->md5str, &part->md5b);
-    part->sha256 = sha256_base16(buf, buf_len); 
-    // 2. calculate MD5 of multiple message blocks
-    MD5_Update (&wdata->fop->md5, buf, buf_len);
-
-    wdata->fop->l_parts = g_list_append (wdata->fop->l_parts, part);
-
     path = g_strdup_printf ("%s?partNumber=%u&uploadId=%s",
-        wdata->fop->fname, wdata->fop->part_number, wdata->fop->uploadid);
-
-    // increase part number
-    wdata->fop->part_number++;
-    // XXX: check that part_number does not exceeds 10000
+        upload->fop->fname, upload->part->part_number, upload->fop->uploadid);
 
     // add output headers
-    http_connection_add_output_header (con, "Content-MD5", part->md5b);
-    http_connection_add_output_header (con, "x-amz-content-sha256", part->sha256);
+    http_connection_add_output_header (con, "Content-MD5", upload->part->md5b);
+    http_connection_add_output_header (con, "x-amz-content-sha256", upload->part->sha256);
 
     res = http_connection_make_request (con,
-        path, "PUT", wdata->fop->write_buf, TRUE, NULL,
+        path, "PUT", upload->buf, TRUE, NULL,
         fileio_write_on_send_cb,
-        wdata
+        upload
     );
     g_free (path);
 
     if (!res) {
-        LOG_err (FIO_LOG, INO_CON_H"Failed to create HTTP request !", INO_T (wdata->ino), (void *)con);
+        LOG_err (FIO_LOG, INO_CON_H"Failed to create HTTP request !", INO_T (upload->fop->ino), (void *)con);
         http_connection_release (con);
-        wdata->on_buffer_written_cb (wdata->fop, wdata->ctx, FALSE, 0);
-        g_free (wdata);
+        fileio_write_on_part_done (upload, FALSE);
         return;
     }
 }
 
-static void fileio_write_send_part (FileWriteData *wdata)
+static void fileio_write_send_part (FileIOPartUpload *upload)
 {
-    if (!wdata->fop->uploadid) {
-        LOG_err (FIO_LOG, INO_H"UploadID is not set, aborting operation !", INO_T (wdata->ino));
-        wdata->on_buffer_written_cb (wdata->fop, wdata->ctx, FALSE, 0);
-        g_free (wdata);
+    if (!upload->fop->uploadid) {
+        LOG_err (FIO_LOG, INO_H"UploadID is not set, aborting operation !", INO_T (upload->fop->ino));
+        fileio_write_on_part_done (upload, FALSE);
         return;
     }
 
-    if (!client_pool_get_client (application_get_write_client_pool (wdata->fop->app),
-        fileio_write_on_send_con_cb, wdata)) {
-        LOG_err (FIO_LOG, INO_H"Failed to get HTTP client !", INO_T (wdata->ino));
-        wdata->on_buffer_written_cb (wdata->fop, wdata->ctx, FALSE, 0);
-        g_free (wdata);
+    if (!client_pool_get_client (application_get_write_client_pool (upload->fop->app),
+        fileio_write_on_send_con_cb, upload)) {
+        LOG_err (FIO_LOG, INO_H"Failed to get HTTP client !", INO_T (upload->fop->ino));
+        fileio_write_on_part_done (upload, FALSE);
         return;
     }
 }
+
+// part is hashed, send it as soon as upload ID is known
+static void fileio_write_on_part_hashed_cb (gpointer ctx)
+{
+    FileIOPartUpload *upload = (FileIOPartUpload *) ctx;
+    FileIO *fop = upload->fop;
+
+    // one of the previous parts or multipart init failed
+    if (fop->upload_failed) {
+        fileio_write_on_part_done (upload, FALSE);
+
+    // upload ID is not received yet
+    } else if (!fop->uploadid) {
+        g_queue_push_tail (fop->q_parts_waiting, upload);
+
+    } else {
+        fileio_write_send_part (upload);
+    }
+}
 /*}}}*/
 
 /*{{{ Multipart Init */
@@ -506,50 +798,56 @@ static gchar *get_uploadid (const char *xml, size_t xml_len) {
     return uploadid;
 }
 
+// sends parts which were waiting for the multipart upload ID
+static void fileio_write_send_waiting_parts (FileIO *fop)
+{
+    FileIOPartUpload *upload;
+
+    while ((upload = g_queue_pop_head (fop->q_parts_waiting)))
+        fileio_write_send_part (upload);
+}
+
 static void fileio_write_on_multipart_init_cb (HttpConnection *con, void *ctx, gboolean success,
     const gchar *buf, size_t buf_len,
     G_GNUC_UNUSED struct evkeyvalq *headers)
 {
-    FileWriteData *wdata = (FileWriteData *) ctx;
+    FileIO *fop = (FileIO *) ctx;
     gchar *uploadid;
 
     http_connection_release (con);
 
-    wdata->fop->multipart_initiated = TRUE;
-
     if (!success || !buf_len) {
-        LOG_err (FIO_LOG, INO_CON_H"Failed to get multipart init data from the server !", INO_T (wdata->ino), (void *)con);
-        wdata->on_buffer_written_cb (wdata->fop, wdata->ctx, FALSE, 0);
-        g_free (wdata);
+        LOG_err (FIO_LOG, INO_CON_H"Failed to get multipart init data from the server !", INO_T (fop->ino), (void *)con);
+        fop->upload_failed = TRUE;
+        fileio_write_send_waiting_parts (fop);
         return;
     }
 
     uploadid = get_uploadid (buf, buf_len);
     if (!uploadid) {
-        LOG_err (FIO_LOG, INO_CON_H"Failed to parse multipart init data!", INO_T (wdata->ino), (void *)con);
-        wdata->on_buffer_written_cb (wdata->fop, wdata->ctx, FALSE, 0);
-        g_free (wdata);
+        LOG_err (FIO_LOG, INO_CON_H"Failed to parse multipart init data!", INO_T (fop->ino), (void *)con);
+        fop->upload_failed = TRUE;
+        fileio_write_send_waiting_parts (fop);
         return;
     }
-    wdata->fop->uploadid = g_strdup (uploadid);
+    fop->uploadid = g_strdup (uploadid);
     xmlFree (uploadid);
 
-    // done, resume uploading part
-    wdata->fop->part_number = 1;
-    fileio_write_send_part (wdata);
+    // done, resume uploading parts
+    fileio_write_send_waiting_parts (fop);
 }
 
 // got HttpConnection object
 static void fileio_write_on_multipart_init_con_cb (gpointer client, gpointer ctx)
 {
     HttpConnection *con = (HttpConnection *) client;
-    FileWriteData *wdata = (FileWriteData *) ctx;
+    FileIO *fop = (FileIO *) ctx;
     gboolean res;
     gchar *path;
 
     http_connection_acquire (con);
 
-    path = g_strdup_printf ("%s?uploads", wdata->fop->fname);
+    path = g_strdup_printf ("%s?uploads", fop->fname);
 
     // send storage class with the init request
     http_connection_add_output_header (con, "x-amz-storage-class", conf_get_string (application_get_conf (con->app), "s3.storage_type"));
@@ -557,26 +855,28 @@ static void fileio_write_on_multipart_init_con_cb (gpointer client, gpointer ctx
     res = http_connection_make_request (con,
         path, "POST", NULL, TRUE, NULL,
         fileio_write_on_multipart_init_cb,
-        wdata
+        fop
     );
     g_free (path);
 
     if (!res) {
-        LOG_err (FIO_LOG, INO_CON_H"Failed to create HTTP request !", INO_T (wdata->ino), (void *)con);
+        LOG_err (FIO_LOG, INO_CON_H"Failed to create HTTP request !", INO_T (fop->ino), (void *)con);
         http_connection_release (con);
-        wdata->on_buffer_written_cb (wdata->fop, wdata->ctx, FALSE, 0);
-        g_free (wdata);
+        fop->upload_failed = TRUE;
+        fileio_write_send_waiting_parts (fop);
         return;
     }
 }
 
-static void fileio_write_init_multipart (FileWriteData *wdata)
+static void fileio_write_init_multipart (FileIO *fop)
 {
-    if (!client_pool_get_client (application_get_write_client_pool (wdata->fop->app),
-        fileio_write_on_multipart_init_con_cb, wdata)) {
-        LOG_err (FIO_LOG, INO_H"Failed to get HTTP client !", INO_T (wdata->ino));
-        wdata->on_buffer_written_cb (wdata->fop, wdata->ctx, FALSE, 0);
-        g_free (wdata);
+    fop->multipart_initiated = TRUE;
+
+    if (!client_pool_get_client (application_get_write_client_pool (fop->app),
+        fileio_write_on_multipart_init_con_cb, fop)) {
+        LOG_err (FIO_LOG, INO_H"Failed to get HTTP client !", INO_T (fop->ino));
+        fop->upload_failed = TRUE;
+        fileio_write_send_waiting_parts (fop);
         return;
     }
 }
@@ -588,6 +888,13 @@ void fileio_write_buffer (FileIO *fop,
 {
     FileWriteData *wdata;
 
+    // one of the previous parts failed to upload
+    if (fop->upload_failed) {
+        LOG_err (FIO_LOG, INO_H"Failed to upload file, rejecting write call !", INO_T (ino));
+        on_buffer_written_cb (fop, ctx, FALSE, 0);
+        return;
+    }
+
     // XXX: allow only sequentially write
     // current written bytes should be always match offset
     if (off >= 0 && fop->current_size != (guint64)off) {
@@ -609,28 +916,43 @@ void fileio_write_buffer (FileIO *fop,
 
     // if current write buffer exceeds "part_size" - this is a multipart upload
     if (evbuffer_get_length (fop->write_buf) >= conf_get_uint (application_get_conf (fop->app), "s3.part_size")) {
-        // init helper struct
-        wdata = g_new0 (FileWriteData, 1);
-        wdata->fop = fop;
-        wdata->buf_size = buf_size;
-        wdata->off = off;
-        wdata->ino = ino;
-        wdata->on_buffer_written_cb = on_buffer_written_cb;
-        wdata->ctx = ctx;
-
-        // init multipart upload
-        if (!fop->multipart_initiated) {
-            fileio_write_init_multipart (wdata);
-
-        // else send the current part
-        } else {
-            fileio_write_send_part (wdata);
+        FileIOPartUpload *upload;
+
+        upload = fileio_part_upload_create (fop);
+        fop->parts_in_flight++;
+
+        LOG_debug (FIO_LOG, INO_H"Part %u: %zu bytes, parts in flight: %u",
+            INO_T (ino), upload->part->part_number, evbuffer_get_length (upload->buf), fop->parts_in_flight);
+
+        // init multipart upload, parts are sent once upload ID is received
+        if (!fop->multipart_initiated)
+            fileio_write_init_multipart (fop);
+
+        // the part is sent once hashes are calculated
+        fileio_part_hash (upload, fileio_write_on_part_hashed_cb);
+
+        // all parts might be already failed
+        if (fop->upload_failed) {
+            on_buffer_written_cb (fop, ctx, FALSE, 0);
+            return;
         }
 
-    // or just notify client that we are ready for more data
-    } else {
-        on_buffer_written_cb (fop, ctx, TRUE, buf_size);
+        // too many parts in flight, delay the reply until one of them is sent
+        if (fop->parts_in_flight >= fileio_write_get_max_parts (fop)) {
+            wdata = g_new0 (FileWriteData, 1);
+            wdata->fop = fop;
+            wdata->buf_size = buf_size;
+            wdata->off = off;
+            wdata->ino = ino;
+            wdata->on_buffer_written_cb = on_buffer_written_cb;
+            wdata->ctx = ctx;
+            g_queue_push_tail (fop->q_write_waiting, wdata);
+            return;
+        }
     }
+
+    // notify client that we are ready for more data
+    on_buffer_written_cb (fop, ctx, TRUE, buf_size);
 }
 /*}}}*/
 
@@ -642,36 +964,85 @@ typedef struct {
     off_t off;
     fuse_ino_t ino;
     off_t request_offset;
+    guint64 request_size;
+    gboolean pending; // requested range is registered as being downloaded
     FileIO_on_buffer_read_cb on_buffer_read_cb;
+    FileIO_on_fd_read_cb on_fd_read_cb;
     gpointer ctx;
     char *aws_etag;
     gboolean cache_etag_is_set;
+    guint holes_waiting; // number of missing parts which are being downloaded
+    gboolean holes_failed;
+
+    // streamed GET response
+    gboolean stream_failed; // response does not contain ETag
+    char *stream_buf; // requested range, collected from the response chunks
+    guint64 stream_filled; // bytes of "stream_buf" received so far
+    gboolean replied; // reply is sent before the whole response is received
+    FileCacheWriter writer;
 } FileReadData;
 
+// part of the requested range which is not in the local cache
+typedef struct {
+    guint64 start;
+    guint64 end;
+} FileReadHole;
+
+// notifies other readers which are waiting for the requested range
+static void fileread_pending_done (FileReadData *rdata, gboolean success)
+{
+    if (!rdata->pending)
+        return;
+
+    rdata->pending = FALSE;
+    cache_mng_pending_done (application_get_cache_mng (rdata->fop->app),
+        rdata->ino, rdata->request_size, rdata->request_offset, success);
+}
+
 void fileread_destroy (FileReadData *rdata)
 {
+    fileio_cache_writer_free (&rdata->writer);
+    fileread_pending_done (rdata, FALSE);
+
     if (rdata->aws_etag)
         g_free (rdata->aws_etag);
+    if (rdata->stream_buf)
+        g_free (rdata->stream_buf);
     g_free (rdata);
 }
 
-static void fileio_read_get_buf (FileReadData *rdata);
-
-static gboolean insure_cache_etag_consistent_or_invalidate_cache(struct evkeyvalq *headers, FileReadData *rdata)
+// copies "len" bytes starting at "pos" of the evbuffer, the evbuffer is not modified
+static void fileio_evbuffer_copyout (struct evbuffer *evb, guint64 pos, char *out, guint64 len)
 {
-    const char *aws_etag, *cached_etag;
+    struct evbuffer_ptr ptr;
+    struct evbuffer_iovec *vec;
+    int i, n;
 
-    // consistency checking:
-    //    If AWS and cached ETag's aren't equal, invalidate local cache
+    if (evbuffer_ptr_set (evb, &ptr, pos, EVBUFFER_PTR_SET) < 0)
+        return;
 
-    aws_etag = http_find_header (headers, "ETag");
+    n = evbuffer_peek (evb, len, &ptr, NULL, 0);
+    vec = g_new (struct evbuffer_iovec, n);
+    n = evbuffer_peek (evb, len, &ptr, vec, n);
 
-    if (!aws_etag) {
-        LOG_err (FIO_LOG, INO_H"Header fails to contain ETag!", INO_T (rdata->ino));
-        rdata->on_buffer_read_cb (rdata->ctx, FALSE, NULL, 0);
-        fileread_destroy (rdata);
-        return FALSE;
+    for (i = 0; i < n && len; i++) {
+        size_t l = MIN (vec[i].iov_len, len);
+
+        memcpy (out, vec[i].iov_base, l);
+        out += l;
+        len -= l;
     }
+    g_free (vec);
+}
+
+static void fileio_read_get_buf (FileReadData *rdata);
+static void fileio_read_start (FileReadData *rdata);
+
+// consistency checking:
+//    If AWS and cached ETag's aren't equal, invalidate local cache
+static void fileio_read_check_cache_etag (FileReadData *rdata, const char *aws_etag)
+{
+    const char *cached_etag;
 
     if (!rdata->aws_etag)
         rdata->aws_etag = strdup (aws_etag);
@@ -690,6 +1061,9 @@ static gboolean insure_cache_etag_consistent_or_invalidate_cache(struct evkeyval
             LOG_debug (FIO_LOG, INO_H"ETags differ, invalidating local cached file!: AWS %.8s..., cache %.8s...",
                 INO_T (rdata->ino), rdata->aws_etag+1, cached_etag+1);
             cache_mng_remove_file (application_get_cache_mng (rdata->fop->app), rdata->ino);
+            // the file is still opened, new data belongs to the same path
+            cache_mng_set_file_path (application_get_cache_mng (rdata->fop->app), rdata->ino, rdata->fop->fname, TRUE);
+            rfuse_inval_inode (application_get_rfuse (rdata->fop->app), rdata->ino);
         }
     } else {
         if (cache_mng_update_etag (application_get_cache_mng (rdata->fop->app), rdata->ino, rdata->aws_etag)) {
@@ -697,47 +1071,385 @@ static gboolean insure_cache_etag_consistent_or_invalidate_cache(struct evkeyval
             rdata->cache_etag_is_set = TRUE;
         }
     }
-
-    return TRUE;
 }
 
-/*{{{ GET request */
-static void fileio_read_on_get_cb (HttpConnection *con, void *ctx, gboolean success,
-    const gchar *buf, size_t buf_len, struct evkeyvalq *headers)
+static gboolean insure_cache_etag_consistent_or_invalidate_cache(struct evkeyvalq *headers, FileReadData *rdata)
 {
-    FileReadData *rdata = (FileReadData *) ctx;
-    const char *cached_etag;
+    const char *aws_etag;
 
-    // release HttpConnection
-    http_connection_release (con);
+    aws_etag = http_find_header (headers, "ETag");
 
-    if (!success) {
-        LOG_err (FIO_LOG, INO_CON_H"Failed to get file from server !", INO_T (rdata->ino), (void *)con);
+    if (!aws_etag) {
+        LOG_err (FIO_LOG, INO_H"Header fails to contain ETag!", INO_T (rdata->ino));
         rdata->on_buffer_read_cb (rdata->ctx, FALSE, NULL, 0);
         fileread_destroy (rdata);
-        return;
+        return FALSE;
+    }
+
+    fileio_read_check_cache_etag (rdata, aws_etag);
+
+    return TRUE;
+}
+
+// size and ETag from the directory listing are fresh enough to replace HEAD request
+static gboolean fileio_read_use_listing (FileReadData *rdata)
+{
+    const gchar *etag;
+    gchar *aws_etag;
+    guint64 size;
+
+    if (!dir_tree_get_entry_meta (application_get_dir_tree (rdata->fop->app), rdata->ino, &size, &etag))
+        return FALSE;
+
+    LOG_debug (FIO_LOG, INO_H"Using listing metadata, size: %"G_GUINT64_FORMAT, INO_T (rdata->ino), size);
+
+    rdata->fop->file_size = size;
+    rdata->fop->head_req_sent = TRUE;
+
+    // response headers contain quoted ETag
+    aws_etag = g_strdup_printf ("\"%s\"", etag);
+    fileio_read_check_cache_etag (rdata, aws_etag);
+    g_free (aws_etag);
+
+    return TRUE;
+}
+
+/*{{{ readahead */
+
+static void fileio_readahead_schedule (FileIO *fop);
+
+static void fileio_readahead_destroy (FileReadAhead *ra)
+{
+    fileio_cache_writer_free (&ra->writer);
+    cache_mng_pending_done (application_get_cache_mng (ra->app), ra->ino, ra->size, ra->off, ra->success);
+
+    if (ra->fop) {
+        ra->fop->l_readahead = g_list_remove (ra->fop->l_readahead, ra);
+        ra->fop->readahead_count--;
     }
+    g_free (ra->fname);
+    g_free (ra);
+}
+
+// response data is stored into the cache as it arrives
+static void fileio_readahead_on_chunk_cb (HttpConnection *con, void *ctx, struct evkeyvalq *headers,
+    struct evbuffer *chunk, guint64 off)
+{
+    FileReadAhead *ra = (FileReadAhead *) ctx;
+    CacheMng *cmng = application_get_cache_mng (ra->app);
+    const char *aws_etag, *cached_etag;
 
-    if (!insure_cache_etag_consistent_or_invalidate_cache(headers, rdata))
+    // do not mix data of different object versions
+    if (!off) {
+        fileio_cache_writer_reset (&ra->writer);
+        aws_etag = http_find_header (headers, "ETag");
+        cached_etag = cache_mng_get_etag (cmng, ra->ino);
+        ra->stream_failed = (!aws_etag || (cached_etag && strcmp (aws_etag, cached_etag)));
+        if (ra->stream_failed)
+            LOG_debug (FIO_LOG, INO_CON_H"Object has changed, dropping readahead data", INO_T (ra->ino), (void *)con);
+    }
+    if (ra->stream_failed)
         return;
 
-    // store it in the local cache
-    cache_mng_store_file_buf (application_get_cache_mng (rdata->fop->app),
-        rdata->ino, buf_len, rdata->request_offset, (unsigned char *) buf,
-        NULL, NULL);
+    fileio_cache_writer_add (&ra->writer, ra->app, ra->ino, chunk, ra->off + off);
+    if (!off && !cache_mng_get_etag (cmng, ra->ino))
+        cache_mng_update_etag (cmng, ra->ino, http_find_header (headers, "ETag"));
+}
 
-    cached_etag = cache_mng_get_etag (application_get_cache_mng (rdata->fop->app), rdata->ino);
-    LOG_debug (FIO_LOG, INO_H"Read from server done, AWS etag %.8s..., cache etag %.8s...",
-        INO_T (rdata->ino), rdata->aws_etag+1, cached_etag ? cached_etag+1 : "not set");
+static void fileio_readahead_on_get_cb (HttpConnection *con, void *ctx, gboolean success,
+    G_GNUC_UNUSED const gchar *buf, size_t buf_len, G_GNUC_UNUSED struct evkeyvalq *headers)
+{
+    FileReadAhead *ra = (FileReadAhead *) ctx;
+    FileIO *fop;
+
+    http_connection_release (con);
+
+    if (!success || ra->stream_failed) {
+        LOG_debug (FIO_LOG, INO_CON_H"Readahead request failed !", INO_T (ra->ino), (void *)con);
+        fileio_readahead_destroy (ra);
+        return;
+    }
+
+    fileio_cache_writer_flush (&ra->writer, ra->app, ra->ino);
+    ra->success = TRUE;
+
+    LOG_debug (FIO_LOG, INO_H"Readahead stored [%"G_GUINT64_FORMAT" %zu]", INO_T (ra->ino), ra->off, buf_len);
 
-    if (rdata->aws_etag && !cached_etag) {
+    // keep the window full
+    fop = ra->fop;
+    fileio_readahead_destroy (ra);
+    if (fop)
+        fileio_readahead_schedule (fop);
+}
+
+// got HttpConnection object
+static void fileio_readahead_on_con_cb (gpointer client, gpointer ctx)
+{
+    HttpConnection *con = (HttpConnection *) client;
+    FileReadAhead *ra = (FileReadAhead *) ctx;
+    gchar *range_hdr;
+    gboolean res;
+
+    http_connection_acquire (con);
+
+    range_hdr = g_strdup_printf ("bytes=%"G_GUINT64_FORMAT"-%"G_GUINT64_FORMAT,
+        ra->off, ra->off + ra->size - 1);
+    http_connection_add_output_header (con, "Range", range_hdr);
+    g_free (range_hdr);
+    http_connection_set_on_chunk_cb (con, fileio_readahead_on_chunk_cb);
+
+    res = http_connection_make_request (con,
+        ra->fname, "GET", NULL, TRUE, NULL,
+        fileio_readahead_on_get_cb,
+        ra
+    );
+
+    if (!res) {
+        LOG_err (FIO_LOG, INO_CON_H"Failed to create HTTP request !", INO_T (ra->ino), (void *)con);
+        http_connection_release (con);
+        fileio_readahead_destroy (ra);
+        return;
+    }
+}
+
+// sends ranged GET request, data is stored into the cache,
+// "prio" is CLIENT_POOL_PRIO_READ for the data a reader waits for
+// returns FALSE if request can't be sent
+static gboolean fileio_readahead_send (FileIO *fop, guint64 off, guint64 size, ClientPoolPriority prio)
+{
+    FileReadAhead *ra;
+
+    ra = g_new0 (FileReadAhead, 1);
+    ra->app = fop->app;
+    ra->fop = fop;
+    ra->fname = g_strdup (fop->fname);
+    ra->ino = fop->ino;
+    ra->off = off;
+    ra->size = size;
+
+    fop->l_readahead = g_list_prepend (fop->l_readahead, ra);
+    fop->readahead_count++;
+    cache_mng_pending_add (application_get_cache_mng (fop->app), ra->ino, ra->size, ra->off);
+
+    if (!client_pool_get_client_prio (application_get_read_client_pool (fop->app), prio,
+        fileio_readahead_on_con_cb, ra)) {
+        LOG_debug (FIO_LOG, INO_H"Failed to get HTTP client for ranged GET !", INO_T (fop->ino));
+        fileio_readahead_destroy (ra);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+// updates sequential access detector with the new read request
+static void fileio_readahead_on_read (FileIO *fop, size_t size, off_t off)
+{
+    if (off >= 0 && (guint64) off <= fop->last_read_end + FIO_READAHEAD_REORDER_WINDOW &&
+        (guint64) off + size + FIO_READAHEAD_REORDER_WINDOW >= fop->last_read_end) {
+        fop->seq_reads++;
+        fop->last_read_end = MAX (fop->last_read_end, (guint64) off + size);
+    } else {
+        // random access, start over
+        fop->seq_reads = 0;
+        fop->readahead_off = 0;
+        fop->last_read_end = (guint64) off + size;
+    }
+}
+
+// sends ranged GET requests to fill the cache ahead of a sequential reader
+static void fileio_readahead_schedule (FileIO *fop)
+{
+    CacheMng *cmng = application_get_cache_mng (fop->app);
+    guint readahead_parts;
+    guint64 part_size;
+    guint64 window_end;
+
+    if (!conf_node_exists (application_get_conf (fop->app), "s3.readahead_parts"))
+        return;
+    readahead_parts = conf_get_uint (application_get_conf (fop->app), "s3.readahead_parts");
+    part_size = conf_get_uint (application_get_conf (fop->app), "s3.part_size");
+
+    if (!readahead_parts || !part_size || fop->seq_reads < FIO_READAHEAD_SEQ_READS)
+        return;
+
+    // the whole small file is requested by the regular read path
+    if (fop->file_size < part_size)
+        return;
+
+    if (fop->readahead_off < fop->last_read_end)
+        fop->readahead_off = fop->last_read_end;
+
+    window_end = MIN (fop->last_read_end + readahead_parts * part_size, fop->file_size);
+
+    while (fop->readahead_count < readahead_parts && fop->readahead_off < window_end) {
+        guint64 size = MIN (part_size, fop->file_size - fop->readahead_off);
+
+        // already in the local cache or being downloaded
+        if (cache_mng_has_range (cmng, fop->ino, size, fop->readahead_off) ||
+            cache_mng_pending_exists (cmng, fop->ino, size, fop->readahead_off)) {
+            fop->readahead_off += size;
+            continue;
+        }
+
+        LOG_debug (FIO_LOG, INO_H"Readahead [%"G_GUINT64_FORMAT" %"G_GUINT64_FORMAT"]", INO_T (fop->ino), fop->readahead_off, size);
+
+        if (!fileio_readahead_send (fop, fop->readahead_off, size, CLIENT_POOL_PRIO_READAHEAD)) {
+            // try again on the next read
+            return;
+        }
+        fop->readahead_off += size;
+    }
+}
+
+// splits a sequential download of a large file into several concurrent ranged requests:
+// the caller fetches the first "stripe_size" bytes starting at "off",
+// the following stripes are downloaded in parallel and stored into the cache
+static void fileio_read_send_stripes (FileIO *fop, guint64 off, guint64 stripe_size)
+{
+    ConfData *conf = application_get_conf (fop->app);
+    CacheMng *cmng = application_get_cache_mng (fop->app);
+    guint stripes;
+    guint64 min_size = 0;
+    guint i;
+
+    if (!conf_node_exists (conf, "s3.read_stripes"))
+        return;
+    stripes = conf_get_uint (conf, "s3.read_stripes");
+    if (conf_node_exists (conf, "s3.read_stripes_min_size"))
+        min_size = conf_get_uint (conf, "s3.read_stripes_min_size");
+
+    // random reads would only waste bandwidth
+    if (stripes < 2 || fop->seq_reads < FIO_READAHEAD_SEQ_READS || fop->file_size < min_size)
+        return;
+
+    off += stripe_size;
+    for (i = 1; i < stripes && off < fop->file_size; i++) {
+        guint64 size = MIN (stripe_size, fop->file_size - off);
+
+        if (!cache_mng_has_range (cmng, fop->ino, size, off) &&
+            !cache_mng_pending_exists (cmng, fop->ino, size, off)) {
+            LOG_debug (FIO_LOG, INO_H"Stripe [%"G_GUINT64_FORMAT" %"G_GUINT64_FORMAT"]", INO_T (fop->ino), off, size);
+            if (!fileio_readahead_send (fop, off, size, CLIENT_POOL_PRIO_READAHEAD))
+                break;
+        }
+        off += size;
+    }
+
+    // do not request the same ranges again
+    if (fop->readahead_off < off)
+        fop->readahead_off = off;
+}
+/*}}}*/
+
+/*{{{ GET request */
+// the object is changed since its size was received, takes the new size from the response headers
+static void fileio_read_update_size (FileReadData *rdata, struct evkeyvalq *headers, const char *aws_etag)
+{
+    const char *range_header, *len_header;
+    gint64 size = -1;
+
+    range_header = http_find_header (headers, "Content-Range");
+    len_header = http_find_header (headers, "Content-Length");
+    // "bytes start-end/total"
+    if (range_header) {
+        const char *total = strrchr (range_header, '/');
+
+        if (total && total[1] != '*')
+            size = strtoll (total + 1, NULL, 10);
+    } else if (len_header) {
+        size = strtoll (len_header, NULL, 10);
+    }
+
+    if (size < 0) {
+        LOG_err (FIO_LOG, INO_H"Object is changed, but its size is unknown !", INO_T (rdata->ino));
+        return;
+    }
+
+    LOG_debug (FIO_LOG, INO_H"Object is changed, size: %"G_GUINT64_FORMAT" -> %"G_GINT64_FORMAT,
+        INO_T (rdata->ino), rdata->fop->file_size, size);
+
+    rdata->fop->file_size = size;
+    dir_tree_set_entry_meta (application_get_dir_tree (rdata->fop->app), rdata->ino, size, aws_etag);
+    rfuse_inval_inode (application_get_rfuse (rdata->fop->app), rdata->ino);
+}
+
+// response data is stored into the cache as it arrives,
+// the reader gets its range as soon as it is received
+static void fileio_read_on_chunk_cb (HttpConnection *con, void *ctx, struct evkeyvalq *headers,
+    struct evbuffer *chunk, guint64 off)
+{
+    FileReadData *rdata = (FileReadData *) ctx;
+    CacheMng *cmng = application_get_cache_mng (rdata->fop->app);
+    guint64 chunk_start = rdata->request_offset + off;
+    guint64 chunk_end = chunk_start + evbuffer_get_length (chunk);
+    guint64 start, end;
+    const char *aws_etag;
+
+    // headers are checked by the first chunk of every attempt
+    if (!off) {
+        fileio_cache_writer_reset (&rdata->writer);
+        aws_etag = http_find_header (headers, "ETag");
+        rdata->stream_failed = !aws_etag;
+        if (!aws_etag) {
+            LOG_err (FIO_LOG, INO_CON_H"Header fails to contain ETag!", INO_T (rdata->ino), (void *)con);
+        } else {
+            // listing or HEAD response is stale
+            if (rdata->aws_etag && strcmp (rdata->aws_etag, aws_etag))
+                fileio_read_update_size (rdata, headers, aws_etag);
+            fileio_read_check_cache_etag (rdata, aws_etag);
+        }
+    }
+    if (rdata->stream_failed)
+        return;
+
+    // the part of the chunk which is requested by the reader
+    start = MAX (chunk_start, (guint64) rdata->off);
+    end = MIN (chunk_end, rdata->off + rdata->size);
+    if (!rdata->replied && start < end) {
+        fileio_evbuffer_copyout (chunk, start - chunk_start, rdata->stream_buf + (start - rdata->off), end - start);
+        rdata->stream_filled = MAX (rdata->stream_filled, end - rdata->off);
+    }
+
+    fileio_cache_writer_add (&rdata->writer, rdata->fop->app, rdata->ino, chunk, chunk_start);
+    if (!off && !cache_mng_get_etag (cmng, rdata->ino)) {
         LOG_debug (FIO_LOG, INO_H"Setting cache etag: %.8s...", INO_T (rdata->ino), rdata->aws_etag+1);
-        cache_mng_update_etag (application_get_cache_mng (rdata->fop->app), rdata->ino, rdata->aws_etag);
+        cache_mng_update_etag (cmng, rdata->ino, rdata->aws_etag);
     }
 
-    LOG_debug (FIO_LOG, INO_H"Storing [%"G_GUINT64_FORMAT" %zu]", INO_T(rdata->ino), rdata->request_offset, buf_len);
+    if (!rdata->replied && rdata->size && rdata->stream_filled == rdata->size) {
+        LOG_debug (FIO_LOG, INO_H"Reading from response", INO_T (rdata->ino));
+        rdata->replied = TRUE;
+        rdata->on_buffer_read_cb (rdata->ctx, TRUE, rdata->stream_buf, rdata->size);
+    }
+}
+
+static void fileio_read_on_get_cb (HttpConnection *con, void *ctx, gboolean success,
+    G_GNUC_UNUSED const gchar *buf, size_t buf_len, G_GNUC_UNUSED struct evkeyvalq *headers)
+{
+    FileReadData *rdata = (FileReadData *) ctx;
+
+    // release HttpConnection
+    http_connection_release (con);
+
+    if (!success || rdata->stream_failed) {
+        LOG_err (FIO_LOG, INO_CON_H"Failed to get file from server !", INO_T (rdata->ino), (void *)con);
+        if (!rdata->replied)
+            rdata->on_buffer_read_cb (rdata->ctx, FALSE, NULL, 0);
+        fileread_destroy (rdata);
+        return;
+    }
 
-    // and read it
+    fileio_cache_writer_flush (&rdata->writer, rdata->fop->app, rdata->ino);
+    LOG_debug (FIO_LOG, INO_H"Stored [%"G_GUINT64_FORMAT" %zu]", INO_T(rdata->ino), rdata->request_offset, buf_len);
+
+    fileread_pending_done (rdata, TRUE);
+
+    if (rdata->replied) {
+        fileread_destroy (rdata);
+        return;
+    }
+
+    // the response does not cover the requested range, read what is stored
     fileio_read_get_buf (rdata);
 }
 
@@ -747,29 +1459,22 @@ static void fileio_read_on_con_cb (gpointer client, gpointer ctx)
     HttpConnection *con = (HttpConnection *) client;
     FileReadData *rdata = (FileReadData *) ctx;
     gboolean res;
-    guint64 part_size;
 
     http_connection_acquire (con);
 
-    part_size = conf_get_uint (application_get_conf (rdata->fop->app), "s3.part_size");
-
-    // small file - get the whole file at once
-    if (rdata->fop->file_size < part_size)
-        rdata->request_offset = 0;
-
-    // calculate offset
-    else {
+    // a part of the file is requested
+    if (rdata->request_offset > 0 || rdata->request_size < rdata->fop->file_size) {
         gchar *range_hdr;
 
-        if (part_size < rdata->size)
-            part_size = rdata->size;
-
-        rdata->request_offset = rdata->off;
         range_hdr = g_strdup_printf ("bytes=%"G_GUINT64_FORMAT"-%"G_GUINT64_FORMAT,
-            (gint64)rdata->request_offset, (gint64)(rdata->request_offset + part_size));
+            (gint64)rdata->request_offset, (gint64)(rdata->request_offset + rdata->request_size - 1));
         http_connection_add_output_header (con, "Range", range_hdr);
         g_free (range_hdr);
+
+        // download the following ranges using other connections
+        fileio_read_send_stripes (rdata->fop, rdata->request_offset, rdata->request_size);
     }
+    http_connection_set_on_chunk_cb (con, fileio_read_on_chunk_cb);
 
     res = http_connection_make_request (con,
         rdata->fop->fname, "GET", NULL, TRUE, NULL,
@@ -786,6 +1491,138 @@ static void fileio_read_on_con_cb (gpointer client, gpointer ctx)
     }
 }
 
+static void fileio_read_from_server (FileReadData *rdata)
+{
+    guint64 part_size;
+
+    part_size = conf_get_uint (application_get_conf (rdata->fop->app), "s3.part_size");
+
+    // small file - get the whole file at once
+    if (rdata->fop->file_size < part_size) {
+        rdata->request_offset = 0;
+        rdata->request_size = rdata->fop->file_size;
+
+    // calculate offset
+    } else {
+        if (part_size < rdata->size)
+            part_size = rdata->size;
+
+        rdata->request_offset = rdata->off;
+        rdata->request_size = MIN (part_size, rdata->fop->file_size - rdata->off);
+    }
+
+    // let other readers wait for this range instead of requesting it again
+    cache_mng_pending_add (application_get_cache_mng (rdata->fop->app),
+        rdata->ino, rdata->request_size, rdata->request_offset);
+    rdata->pending = TRUE;
+
+    if (!rdata->stream_buf && rdata->size)
+        rdata->stream_buf = g_malloc (rdata->size);
+    rdata->stream_filled = 0;
+
+    // try reading from server, using fileio_read_on_con_cb() callback
+    LOG_debug (FIO_LOG, INO_H"Reading from server !", INO_T (rdata->ino));
+    if (client_pool_get_client (application_get_read_client_pool (rdata->fop->app), fileio_read_on_con_cb, rdata)) {
+        // fileio_read_on_con_cb() callback will resume handling this request
+    } else {
+        // couldn't get HTTP client to try accessing server; fail directly
+        LOG_err (FIO_LOG, INO_H"Failed to get HTTP client !", INO_T (rdata->ino));
+        rdata->on_buffer_read_cb (rdata->ctx, FALSE, NULL, 0);
+        fileread_destroy (rdata);
+        return;
+    }
+}
+
+/*{{{ partial cache hit */
+static void fileio_read_add_hole_cb (guint64 start, guint64 end, void *ctx)
+{
+    GArray *a_holes = (GArray *) ctx;
+    FileReadHole hole;
+
+    hole.start = start;
+    hole.end = end;
+    g_array_append_val (a_holes, hole);
+}
+
+// one of the holes is downloaded (or failed)
+static void fileio_read_on_hole_cb (gboolean success, void *ctx)
+{
+    FileReadData *rdata = (FileReadData *) ctx;
+
+    if (!success)
+        rdata->holes_failed = TRUE;
+
+    if (--rdata->holes_waiting)
+        return;
+
+    // the buffer is assembled from the cache, download the whole range if any of the holes failed
+    if (rdata->holes_failed)
+        fileio_read_from_server (rdata);
+    else
+        fileio_read_get_buf (rdata);
+}
+
+// downloads only parts of the requested range which are not in the local cache
+static void fileio_read_fetch_holes (FileReadData *rdata)
+{
+    CacheMng *cmng = application_get_cache_mng (rdata->fop->app);
+    GArray *a_holes;
+    FileReadHole *hole;
+    guint i;
+
+    a_holes = g_array_new (FALSE, FALSE, sizeof (FileReadHole));
+    cache_mng_foreach_missing (cmng, rdata->ino, rdata->size, rdata->off, fileio_read_add_hole_cb, a_holes);
+
+    // nothing is cached (or cached data can't be read), download the whole range
+    hole = a_holes->len ? &g_array_index (a_holes, FileReadHole, 0) : NULL;
+    if (!hole || (a_holes->len == 1 && hole->start == (guint64) rdata->off &&
+        hole->end == (guint64) rdata->off + rdata->size)) {
+        g_array_free (a_holes, TRUE);
+        fileio_read_from_server (rdata);
+        return;
+    }
+
+    LOG_debug (FIO_LOG, INO_H"Partial cache hit, downloading %u missing parts", INO_T (rdata->ino), a_holes->len);
+
+    // the extra reference is released after all requests are sent
+    rdata->holes_waiting = 1;
+    rdata->holes_failed = FALSE;
+
+    for (i = 0; i < a_holes->len; i++) {
+        guint64 size;
+
+        hole = &g_array_index (a_holes, FileReadHole, i);
+        size = hole->end - hole->start;
+
+        // the hole might be already requested by another reader
+        if (!cache_mng_pending_exists (cmng, rdata->ino, size, hole->start) &&
+            !fileio_readahead_send (rdata->fop, hole->start, size, CLIENT_POOL_PRIO_READ)) {
+            rdata->holes_failed = TRUE;
+            break;
+        }
+
+        if (cache_mng_pending_wait (cmng, rdata->ino, size, hole->start, fileio_read_on_hole_cb, rdata))
+            rdata->holes_waiting++;
+        else
+            rdata->holes_failed = TRUE;
+    }
+    g_array_free (a_holes, TRUE);
+
+    fileio_read_on_hole_cb (TRUE, rdata);
+}
+/*}}}*/
+
+// another request finished downloading the range
+static void fileio_read_on_pending_cb (gboolean success, void *ctx)
+{
+    FileReadData *rdata = (FileReadData *) ctx;
+
+    if (success)
+        fileio_read_get_buf (rdata);
+    else
+        fileio_read_from_server (rdata);
+}
+
 static void fileio_read_on_cache_cb (unsigned char *buf, size_t size, gboolean success, void *ctx)
 {
     FileReadData *rdata = (FileReadData *) ctx;
@@ -796,22 +1633,21 @@ static void fileio_read_on_cache_cb (unsigned char *buf, size_t size, gboolean s
         rdata->on_buffer_read_cb (rdata->ctx, TRUE, (char *)buf, size);
         fileread_destroy (rdata);
     } else {
-        // try reading from server, using fileio_read_on_con_cb() callback
-        LOG_debug (FIO_LOG, INO_H"Reading from server !", INO_T (rdata->ino));
-        if (client_pool_get_client (application_get_read_client_pool (rdata->fop->app), fileio_read_on_con_cb, rdata)) {
-            // fileio_read_on_con_cb() callback will resume handling this request
-        } else {
-            // couldn't get HTTP client to try accessing server; fail directly
-            LOG_err (FIO_LOG, INO_H"Failed to get HTTP client !", INO_T (rdata->ino));
-            rdata->on_buffer_read_cb (rdata->ctx, FALSE, NULL, 0);
-            fileread_destroy (rdata);
+        // the range is being downloaded by another request, wait for it
+        if (cache_mng_pending_wait (application_get_cache_mng (rdata->fop->app),
+            rdata->ino, rdata->size, rdata->off, fileio_read_on_pending_cb, rdata)) {
+            LOG_debug (FIO_LOG, INO_H"Waiting for pending download", INO_T (rdata->ino));
             return;
         }
+
+        fileio_read_fetch_holes (rdata);
     }
 }
 
 static void fileio_read_get_buf (FileReadData *rdata)
 {
+    FileIO *fop = rdata->fop;
+
     if ((guint64)rdata->off >= rdata->fop->file_size) {
         // requested range is outsize the file size
         LOG_debug (FIO_LOG, INO_H"requested size is beyond the file size!", INO_T (rdata->ino));
@@ -839,21 +1675,58 @@ static void fileio_read_get_buf (FileReadData *rdata)
     LOG_debug (FIO_LOG, INO_H"requesting [%"OFF_FMT": %"G_GUINT64_FORMAT"], file size: %"G_GUINT64_FORMAT,
         INO_T (rdata->ino), rdata->off, rdata->size, rdata->fop->file_size);
 
+    // cached data is passed to the reader without copying it
+    if (rdata->on_fd_read_cb && rdata->size &&
+        cache_mng_read_file_fd (application_get_cache_mng (fop->app), rdata->ino, rdata->size, rdata->off,
+            rdata->on_fd_read_cb, rdata->ctx)) {
+        LOG_debug (FIO_LOG, INO_H"Reading from cache file", INO_T (rdata->ino));
+        fileread_destroy (rdata);
+        fileio_readahead_schedule (fop);
+        return;
+    }
+
     cache_mng_retrieve_file_buf (application_get_cache_mng (rdata->fop->app),
         rdata->ino, rdata->size, rdata->off,
         fileio_read_on_cache_cb, rdata);
+
+    // prefetch data for sequential readers
+    fileio_readahead_schedule (fop);
 }
 /*}}}*/
 
 /*{{{ HEAD request*/
 
+// object headers are received or failed to be received, resumes reads which were waiting for them
+static void fileio_read_resume_waiting (FileIO *fop, gboolean success)
+{
+    GList *l, *l_reads;
+
+    fop->head_in_flight = FALSE;
+    l_reads = fop->l_head_reads;
+    fop->l_head_reads = NULL;
+
+    for (l = g_list_first (l_reads); l; l = g_list_next (l)) {
+        FileReadData *rdata = (FileReadData *) l->data;
+
+        if (success) {
+            fileio_read_start (rdata);
+        } else {
+            rdata->on_buffer_read_cb (rdata->ctx, FALSE, NULL, 0);
+            fileread_destroy (rdata);
+        }
+    }
+    g_list_free (l_reads);
+}
+
 static void fileio_read_on_head_cb (HttpConnection *con, void *ctx, gboolean success,
     G_GNUC_UNUSED const gchar *buf, G_GNUC_UNUSED size_t buf_len,
     struct evkeyvalq *headers)
 {
     FileReadData *rdata = (FileReadData *) ctx;
+    FileIO *fop = rdata->fop;
     const char *content_len_header;
     DirTree *dtree;
+    gboolean consistent;
 
     // release HttpConnection
     http_connection_release (con);
@@ -862,6 +1735,7 @@ static void fileio_read_on_head_cb (HttpConnection *con, void *ctx, gboolean suc
         LOG_err (FIO_LOG, INO_CON_H"Failed to get HEAD from server !", INO_T (rdata->ino), (void *)con);
         rdata->on_buffer_read_cb (rdata->ctx, FALSE, NULL, 0);
         fileread_destroy (rdata);
+        fileio_read_resume_waiting (fop, FALSE);
         return;
     }
 
@@ -887,11 +1761,17 @@ static void fileio_read_on_head_cb (HttpConnection *con, void *ctx, gboolean suc
     }
 
     // Check that the etag we're caching matches the AWS ETag
-    if (!insure_cache_etag_consistent_or_invalidate_cache(headers, rdata))
-        return;
+    consistent = insure_cache_etag_consistent_or_invalidate_cache(headers, rdata);
+    if (consistent) {
+        // resume downloading file
+        fileio_read_get_buf (rdata);
+    } else {
+        // the next read sends HEAD request again
+        fop->head_req_sent = FALSE;
+    }
 
-    // resume downloading file
-    fileio_read_get_buf (rdata);
+    // reads which were waiting for the headers fail as well
+    fileio_read_resume_waiting (fop, consistent);
 }
 
 // got HttpConnection object
@@ -910,20 +1790,152 @@ static void fileio_read_on_head_con_cb (gpointer client, gpointer ctx)
     );
 
     if (!res) {
+        FileIO *fop = rdata->fop;
+
         LOG_err (FIO_LOG, INO_CON_H"Failed to create HTTP request !", INO_T (rdata->ino), (void *)con);
         http_connection_release (con);
         rdata->on_buffer_read_cb (rdata->ctx, FALSE, NULL, 0);
         fileread_destroy (rdata);
+        fileio_read_resume_waiting (fop, FALSE);
+        return;
+    }
+}
+
+static void fileio_read_send_head (FileReadData *rdata)
+{
+    FileIO *fop = rdata->fop;
+
+    fop->head_in_flight = TRUE;
+
+    // get HTTP connection to download manifest or a full file
+    if (!client_pool_get_client (application_get_read_client_pool (rdata->fop->app), fileio_read_on_head_con_cb, rdata)) {
+        LOG_err (FIO_LOG, INO_H"Failed to get HTTP client !", INO_T (rdata->ino));
+        rdata->on_buffer_read_cb (rdata->ctx, FALSE, NULL, 0);
+        fileread_destroy (rdata);
+        fileio_read_resume_waiting (fop, FALSE);
+    }
+}
+/*}}}*/
+
+/*{{{ prefetch on open */
+// the whole object is downloaded, reads which were waiting for it are resumed
+static void fileio_prefetch_destroy (FileReadAhead *ra)
+{
+    FileIO *fop = ra->fop;
+
+    cache_mng_pending_done (application_get_cache_mng (ra->app), ra->ino, ra->size, ra->off, ra->success);
+    g_free (ra->fname);
+    g_free (ra);
+
+    if (!fop)
+        return;
+
+    fop->prefetch = NULL;
+
+    // response headers replace HEAD, otherwise the first waiting read sends it
+    fileio_read_resume_waiting (fop, TRUE);
+}
+
+static void fileio_prefetch_on_get_cb (HttpConnection *con, void *ctx, gboolean success,
+    const gchar *buf, size_t buf_len, struct evkeyvalq *headers)
+{
+    FileReadAhead *ra = (FileReadAhead *) ctx;
+    CacheMng *cmng = application_get_cache_mng (ra->app);
+    const char *aws_etag, *cached_etag;
+
+    http_connection_release (con);
+
+    aws_etag = success ? http_find_header (headers, "ETag") : NULL;
+    if (!aws_etag) {
+        LOG_debug (FIO_LOG, INO_CON_H"Prefetch request failed !", INO_T (ra->ino), (void *)con);
+        fileio_prefetch_destroy (ra);
+        return;
+    }
+
+    // the object is changed since it was cached
+    cached_etag = cache_mng_get_etag (cmng, ra->ino);
+    if (cached_etag && strcmp (aws_etag, cached_etag)) {
+        LOG_debug (FIO_LOG, INO_H"ETags differ, invalidating local cached file!", INO_T (ra->ino));
+        cache_mng_remove_file (cmng, ra->ino);
+        cache_mng_set_file_path (cmng, ra->ino, ra->fname, TRUE);
+        rfuse_inval_inode (application_get_rfuse (ra->app), ra->ino);
+    }
+
+    cache_mng_store_file_buf (cmng, ra->ino, buf_len, 0, (unsigned char *) buf, NULL, NULL);
+    cache_mng_update_etag (cmng, ra->ino, aws_etag);
+    ra->success = TRUE;
+
+    if (ra->fop) {
+        ra->fop->file_size = buf_len;
+        ra->fop->head_req_sent = TRUE;
+        dir_tree_set_entry_exist (application_get_dir_tree (ra->app), ra->ino);
+    }
+
+    LOG_debug (FIO_LOG, INO_H"Prefetched %zu bytes", INO_T (ra->ino), buf_len);
+
+    fileio_prefetch_destroy (ra);
+}
+
+// got HttpConnection object
+static void fileio_prefetch_on_con_cb (gpointer client, gpointer ctx)
+{
+    HttpConnection *con = (HttpConnection *) client;
+    FileReadAhead *ra = (FileReadAhead *) ctx;
+    gboolean res;
+
+    http_connection_acquire (con);
+
+    res = http_connection_make_request (con,
+        ra->fname, "GET", NULL, TRUE, NULL,
+        fileio_prefetch_on_get_cb,
+        ra
+    );
+
+    if (!res) {
+        LOG_err (FIO_LOG, INO_CON_H"Failed to create HTTP request !", INO_T (ra->ino), (void *)con);
+        http_connection_release (con);
+        fileio_prefetch_destroy (ra);
         return;
     }
 }
+
+void fileio_prefetch (FileIO *fop, guint64 size)
+{
+    CacheMng *cmng = application_get_cache_mng (fop->app);
+    FileReadAhead *ra;
+
+    // the first read validates cached data with HEAD as usual
+    if (fop->prefetch || fop->head_req_sent || !size ||
+        cache_mng_has_range (cmng, fop->ino, size, 0) ||
+        cache_mng_pending_exists (cmng, fop->ino, size, 0))
+        return;
+
+    ra = g_new0 (FileReadAhead, 1);
+    ra->app = fop->app;
+    ra->fop = fop;
+    ra->fname = g_strdup (fop->fname);
+    ra->ino = fop->ino;
+    ra->off = 0;
+    ra->size = size;
+
+    fop->prefetch = ra;
+    cache_mng_pending_add (cmng, ra->ino, ra->size, ra->off);
+
+    LOG_debug (FIO_LOG, INO_H"Prefetching %"G_GUINT64_FORMAT" bytes", INO_T (fop->ino), size);
+
+    if (!client_pool_get_client_prio (application_get_read_client_pool (fop->app), CLIENT_POOL_PRIO_READAHEAD,
+        fileio_prefetch_on_con_cb, ra)) {
+        LOG_debug (FIO_LOG, INO_H"Failed to get HTTP client for prefetch !", INO_T (fop->ino));
+        fileio_prefetch_destroy (ra);
+    }
+}
 /*}}}*/
 
 // if it's the first fuse read() request - send HEAD request to server
 // else try to get data from local cache, otherwise download from the server
 void fileio_read_buffer (FileIO *fop,
     size_t size, off_t off, fuse_ino_t ino,
-    FileIO_on_buffer_read_cb on_buffer_read_cb, gpointer ctx)
+    FileIO_on_buffer_read_cb on_buffer_read_cb, FileIO_on_fd_read_cb on_fd_read_cb, gpointer ctx)
 {
     FileReadData *rdata;
 
@@ -933,19 +1945,33 @@ void fileio_read_buffer (FileIO *fop,
     rdata->off = off;
     rdata->ino = ino;
     rdata->on_buffer_read_cb = on_buffer_read_cb;
+    rdata->on_fd_read_cb = on_fd_read_cb;
     rdata->ctx = ctx;
     rdata->request_offset = off;
     rdata->aws_etag = NULL;
 
+    fileio_readahead_on_read (fop, size, off);
+
+    fileio_read_start (rdata);
+}
+
+static void fileio_read_start (FileReadData *rdata)
+{
+    FileIO *fop = rdata->fop;
+
     // send HEAD request first
     if (!rdata->fop->head_req_sent) {
         rdata->cache_etag_is_set = FALSE;
-         // get HTTP connection to download manifest or a full file
-        if (!client_pool_get_client (application_get_read_client_pool (rdata->fop->app), fileio_read_on_head_con_cb, rdata)) {
-            LOG_err (FIO_LOG, INO_H"Failed to get HTTP client !", INO_T (rdata->ino));
-            rdata->on_buffer_read_cb (rdata->ctx, FALSE, NULL, 0);
-            fileread_destroy (rdata);
+        // the whole object or its headers are being requested by another read, wait for them
+        if (fop->prefetch || fop->head_in_flight) {
+            fop->l_head_reads = g_list_append (fop->l_head_reads, rdata);
+            return;
+        }
+        if (fileio_read_use_listing (rdata)) {
+            fileio_read_get_buf (rdata);
+            return;
         }
+        fileio_read_send_head (rdata);
 
     // HEAD is sent, try to get data from cache
     } else {
@@ -52,6 +52,7 @@ gpointer http_connection_create (Application *app)
 
     con->app = app;
     con->l_output_headers = NULL;
+    con->chunk_cb = NULL;
     con->cur_cmd_type = CMD_IDLE;
     con->cur_url = NULL;
     con->cur_time_start = 0;
@@ -510,17 +511,108 @@ typedef struct {
     gboolean enable_retry;
 
     GList *l_output_headers;
+
+    // streamed response
+    HttpConnection_on_chunk_cb chunk_cb; // NULL if the whole body is passed to response_cb
+    struct evbuffer *in_buffer; // body of unsuccessful response
+    guint64 body_off; // number of bytes passed to chunk_cb by the current attempt
+
+    struct event *ev_retry; // delayed retry
 } RequestData;
 
 static void request_data_free (RequestData *data)
 {
     http_connection_free_headers (data->l_output_headers);
     evbuffer_free (data->out_buffer);
+    if (data->in_buffer)
+        evbuffer_free (data->in_buffer);
+    if (data->ev_retry)
+        event_free (data->ev_retry);
     g_free (data->resource_path);
     g_free (data->http_cmd);
     g_free (data);
 }
 
+// returns the buffer which contains the response body, streamed responses keep only the body of errors
+static struct evbuffer *request_data_get_input_buffer (RequestData *data, struct evhttp_request *req)
+{
+    if (data->chunk_cb)
+        return data->in_buffer;
+
+    return evhttp_request_get_input_buffer (req);
+}
+
+static void http_connection_on_chunk_cb (struct evhttp_request *req, void *ctx)
+{
+    RequestData *data = (RequestData *) ctx;
+    struct evbuffer *inbuf = evhttp_request_get_input_buffer (req);
+    size_t len = evbuffer_get_length (inbuf);
+
+    // keep error message for the response handler
+    if (evhttp_request_get_response_code (req) != 200 &&
+        evhttp_request_get_response_code (req) != 206) {
+        evbuffer_add_buffer (data->in_buffer, inbuf);
+        return;
+    }
+
+    data->chunk_cb (data->con, data->ctx, evhttp_request_get_input_headers (req), inbuf, data->body_off);
+    data->body_off += len;
+}
+
+static void http_connection_on_retry_timer (G_GNUC_UNUSED evutil_socket_t fd, G_GNUC_UNUSED short flags, void *ctx)
+{
+    RequestData *data = (RequestData *) ctx;
+    HttpConnection *con = data->con;
+
+    event_free (data->ev_retry);
+    data->ev_retry = NULL;
+
+    // on failure the request is already completed and "data" is freed
+    if (!http_connection_make_request (data->con, data->resource_path, data->http_cmd, data->out_buffer, data->enable_retry, data,
+        data->response_cb, data->ctx))
+        LOG_err (CON_LOG, CON_H"Failed to send request !", (void *)con);
+}
+
+// exponential backoff with full jitter:
+// a random delay between 0 and base_ms * 2^(retry_id - 1), limited by max_ms
+guint64 http_connection_get_retry_delay (guint64 base_ms, guint64 max_ms, gint retry_id)
+{
+    guint64 delay_ms;
+
+    delay_ms = base_ms << MIN (MAX (retry_id - 1, 0), 16);
+    delay_ms = MIN (delay_ms, max_ms);
+    if (delay_ms)
+        delay_ms = (guint64) g_random_double_range (0, (gdouble) delay_ms + 1);
+
+    return delay_ms;
+}
+
+// re-sends the request after a delay which grows with the number of retries
+static void http_connection_schedule_retry (RequestData *data)
+{
+    ConfData *conf = application_get_conf (data->con->app);
+    guint64 base_ms = 100;
+    guint64 max_ms = 20000;
+    guint64 delay_ms;
+    struct timeval tv;
+
+    if (conf_node_exists (conf, "connection.retry_delay"))
+        base_ms = conf_get_uint (conf, "connection.retry_delay");
+    if (conf_node_exists (conf, "connection.max_retry_delay"))
+        max_ms = conf_get_uint (conf, "connection.max_retry_delay");
+
+    delay_ms = http_connection_get_retry_delay (base_ms, max_ms, data->retry_id);
+
+    LOG_debug (CON_LOG, CON_H"Retrying request in %"G_GUINT64_FORMAT" msec", (void *)data->con, delay_ms);
+
+    evutil_timerclear (&tv);
+    tv.tv_sec = delay_ms / 1000;
+    tv.tv_usec = (delay_ms % 1000) * 1000;
+
+    data->ev_retry = evtimer_new (application_get_evbase (data->con->app), http_connection_on_retry_timer, data);
+    evtimer_add (data->ev_retry, &tv);
+}
+
 static void http_connection_on_response_cb (struct evhttp_request *req, void *ctx)
 {
     RequestData *data = (RequestData *) ctx;
@@ -559,8 +651,8 @@ static void http_connection_on_response_cb (struct evhttp_request *req, void *ct
         struct evkeyvalq *input_headers;
         struct evkeyval *header;
 
-        inbuf = evhttp_request_get_input_buffer (req);
-        buf_len = evbuffer_get_length (inbuf);
+        inbuf = request_data_get_input_buffer (data, req);
+        buf_len = evbuffer_get_length (inbuf) + data->body_off;
 
         output_headers = evhttp_request_get_output_headers (req);
         if (output_headers) {
@@ -588,6 +680,13 @@ static void http_connection_on_response_cb (struct evhttp_request *req, void *ct
         con->cur_code = 500;
     }
 
+    // let the pool adapt the number of parallel requests:
+    // throttling responses and timeouts shrink it, successful responses grow it unless they slow down
+    if (con->pool_ctx)
+        client_pool_on_request_feedback (con->pool_ctx,
+            !req || con->cur_code == 503 || con->cur_code == 429,
+            timeval_diff (&data->start_tv, &end_tv));
+
     s_history = g_strdup_printf ("[%p] %s (%u sec) %s %s %s   HTTP Code: %d (Sent: %zu Received: %zu bytes)",
         (void *)con,
         ts, diff_sec, data->http_cmd, data->con->cur_url,
@@ -628,14 +727,8 @@ static void http_connection_on_response_cb (struct evhttp_request *req, void *ct
                 if (data->response_cb)
                     data->response_cb (data->con, data->ctx, FALSE, NULL, 0, NULL);
             } else {
-                if (!http_connection_make_request (data->con, data->resource_path, data->http_cmd, data->out_buffer, data->enable_retry, data,
-                    data->response_cb, data->ctx)) {
-                    LOG_err (CON_LOG, CON_H"Failed to send request !", (void *)con);
-                    if (data->response_cb)
-                        data->response_cb (data->con, data->ctx, FALSE, NULL, 0, NULL);
-                } else {
-                    return;
-                }
+                http_connection_schedule_retry (data);
+                return;
             }
         } else {
             if (data->response_cb)
@@ -665,7 +758,7 @@ static void http_connection_on_response_cb (struct evhttp_request *req, void *ct
 
         loc = http_find_header (headers, "Location");
         if (!loc) {
-            inbuf = evhttp_request_get_input_buffer (req);
+            inbuf = request_data_get_input_buffer (data, req);
             buf_len = evbuffer_get_length (inbuf);
             buf = (const char *) evbuffer_pullup (inbuf, buf_len);
 
@@ -699,19 +792,14 @@ static void http_connection_on_response_cb (struct evhttp_request *req, void *ct
             goto done;
         }
 
-        // re-send request
+        // re-send request, on failure the request is already completed and "data" is freed
         if (!http_connection_make_request (data->con, data->resource_path, data->http_cmd, data->out_buffer, data->enable_retry, data,
-            data->response_cb, data->ctx)) {
+            data->response_cb, data->ctx))
             LOG_err (CON_LOG, CON_H"Failed to send request !", (void *)con);
-            if (data->response_cb)
-                data->response_cb (data->con, data->ctx, FALSE, NULL, 0, NULL);
-        } else {
-            return;
-        }
-        goto done;
+        return;
     }
 
-    inbuf = evhttp_request_get_input_buffer (req);
+    inbuf = request_data_get_input_buffer (data, req);
     buf_len = evbuffer_get_length (inbuf);
     buf = (const char *) evbuffer_pullup (inbuf, buf_len);
 
@@ -746,14 +834,8 @@ static void http_connection_on_response_cb (struct evhttp_request *req, void *ct
                 if (data->response_cb)
                     data->response_cb (data->con, data->ctx, FALSE, NULL, 0, NULL);
             } else {
-                if (!http_connection_make_request (data->con, data->resource_path, data->http_cmd, data->out_buffer, data->enable_retry, data,
-                    data->response_cb, data->ctx)) {
-                    LOG_err (CON_LOG, CON_H"Failed to send request !", (void *)con);
-                    if (data->response_cb)
-                        data->response_cb (data->con, data->ctx, FALSE, NULL, 0, NULL);
-                } else {
-                    return;
-                }
+                http_connection_schedule_retry (data);
+                return;
             }
         } else {
             if (data->response_cb)
@@ -763,6 +845,12 @@ static void http_connection_on_response_cb (struct evhttp_request *req, void *ct
     }
 
 
+    // the body is already passed to chunk_cb
+    if (data->chunk_cb) {
+        buf = NULL;
+        buf_len = data->body_off;
+    }
+
     if (data->response_cb)
         data->response_cb (data->con, data->ctx, TRUE, buf, buf_len, evhttp_request_get_input_headers (req));
     else
@@ -776,6 +864,12 @@ static gint hdr_compare (const HttpConnectionHeader *a, const HttpConnectionHead
 {
     return strcmp (a->key, b->key);
 }
+// the response body of the next request is passed to "chunk_cb" as it arrives
+void http_connection_set_on_chunk_cb (HttpConnection *con, HttpConnection_on_chunk_cb chunk_cb)
+{
+    con->chunk_cb = chunk_cb;
+}
+
 // add an header to the outgoing request
 void http_connection_add_output_header (HttpConnection *con, const gchar *key, const gchar *value)
 {
@@ -838,12 +932,19 @@ gboolean http_connection_make_request (HttpConnection *con,
     const gchar *bucket_name;
     const gchar *host;
     HttpConnectionHeader* _header;
+    HttpConnection_on_chunk_cb chunk_cb;
+
+    // applies to this request only
+    chunk_cb = con->chunk_cb;
+    con->chunk_cb = NULL;
 
     if (!con->evcon)
         if (!http_connection_init (con)) {
             LOG_err (CON_LOG, CON_H"Failed to init HTTP connection !", (void *)con);
             if (response_cb)
                 response_cb (con, ctx, FALSE, NULL, 0, NULL);
+            if (parent_request_data)
+                request_data_free ((RequestData *) parent_request_data);
             return FALSE;
         }
 
@@ -872,6 +973,9 @@ gboolean http_connection_make_request (HttpConnection *con,
 
         data->retry_id = 0;
         data->enable_retry = enable_retry;
+        data->chunk_cb = chunk_cb;
+        if (chunk_cb)
+            data->in_buffer = evbuffer_new ();
 
         data->l_output_headers = NULL;
 
@@ -934,6 +1038,13 @@ gboolean http_connection_make_request (HttpConnection *con,
         return FALSE;
     }
 
+    // every attempt streams the body from the beginning
+    if (data->chunk_cb) {
+        evhttp_request_set_chunked_cb (req, http_connection_on_chunk_cb);
+        evbuffer_drain (data->in_buffer, evbuffer_get_length (data->in_buffer));
+        data->body_off = 0;
+    }
+
     // introduced _request_headers as a temporary structure so that AWSV4 can manipulate headers...
     for (l = g_list_first (data->l_output_headers); l; l = g_list_next (l)) {
         _header = g_malloc(sizeof(HttpConnectionHeader));
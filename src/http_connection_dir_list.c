@@ -100,6 +100,7 @@ static gboolean parse_dir_xml (DirListRequest *dir_list, const char *xml, size_t
         gchar *name = NULL;
         gchar *s_size = NULL;
         gchar *s_last_modified = NULL;
+        gchar *etag = NULL;
 
         ctx->node = content_nodes->nodeTab[i];
 
@@ -158,9 +159,18 @@ static gboolean parse_dir_xml (DirListRequest *dir_list, const char *xml, size_t
             size = 0;
         }
 
+        key = xmlXPathEvalExpression ((xmlChar *) "s3:ETag", ctx);
+        if (key) {
+            if (key->nodesetval && key->nodesetval->nodeNr > 0)
+                etag = (gchar *)xmlNodeListGetString (doc, key->nodesetval->nodeTab[0]->xmlChildrenNode, 1);
+            xmlXPathFreeObject (key);
+        }
+
         dir_tree_update_entry (dir_list->dir_tree, dir_list->dir_path, DET_file, dir_list->ino,
-            bname, size, last_modified);
+            bname, size, last_modified, etag);
 
+        if (etag)
+            xmlFree (etag);
         xmlFree (name);
     }
 
@@ -214,7 +224,7 @@ static gboolean parse_dir_xml (DirListRequest *dir_list, const char *xml, size_t
         // XXX: save / restore directory mtime
         last_modified = time (NULL);
 
-        dir_tree_update_entry (dir_list->dir_tree, dir_list->dir_path, DET_dir, dir_list->ino, bname, 0, last_modified);
+        dir_tree_update_entry (dir_list->dir_tree, dir_list->dir_path, DET_dir, dir_list->ino, bname, 0, last_modified, NULL);
 
         xmlFree (name);
     }
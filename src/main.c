@@ -23,6 +23,7 @@
 #include "client_pool.h"
 #include "cache_mng.h"
 #include "stat_srv.h"
+#include "worker_pool.h"
 #include "conf_keys.h"
 
 /*{{{ struct */
@@ -38,6 +39,7 @@ struct _Application {
     DirTree *dir_tree;
     CacheMng *cmng;
     StatSrv *stat_srv;
+    WorkerPool *worker_pool;
 
     // initial bucket ACL request
     HttpConnection *service_con;
@@ -122,6 +124,11 @@ StatSrv *application_get_stat_srv (Application *app)
     return app->stat_srv;
 }
 
+WorkerPool *application_get_worker_pool (Application *app)
+{
+    return app->worker_pool;
+}
+
 #ifdef SSL_ENABLED
 SSL_CTX *application_get_ssl_ctx (Application *app)
 {
@@ -359,6 +366,7 @@ static void sigterm_cb (G_GNUC_UNUSED evutil_socket_t sig, G_GNUC_UNUSED short e
 static gint application_finish_initialization_and_run (Application *app)
 {
     struct sigaction sigact;
+    guint idle_timeout = 30;
 
 /*{{{ create Pools */
     // create ClientPool for reading operations
@@ -405,6 +413,37 @@ static gint application_finish_initialization_and_run (Application *app)
         application_exit (app);
         return -1;
     }
+
+    // pools grow on demand and shrink back once the burst is over
+    if (conf_node_exists (app->conf, "pool.idle_timeout"))
+        idle_timeout = conf_get_uint (app->conf, "pool.idle_timeout");
+    if (conf_node_exists (app->conf, "pool.max_readers"))
+        client_pool_set_max_clients (app->read_client_pool, conf_get_int (app->conf, "pool.max_readers"), idle_timeout);
+    if (conf_node_exists (app->conf, "pool.max_writers"))
+        client_pool_set_max_clients (app->write_client_pool, conf_get_int (app->conf, "pool.max_writers"), idle_timeout);
+    if (conf_node_exists (app->conf, "pool.max_operations"))
+        client_pool_set_max_clients (app->ops_client_pool, conf_get_int (app->conf, "pool.max_operations"), idle_timeout);
+
+    client_pool_set_default_prio (app->ops_client_pool, CLIENT_POOL_PRIO_METADATA);
+    client_pool_set_default_prio (app->read_client_pool, CLIENT_POOL_PRIO_READ);
+    client_pool_set_default_prio (app->write_client_pool, CLIENT_POOL_PRIO_WRITEBACK);
+
+    // metadata requests and reads don't wait behind bulk transfers while other pools have idle connections
+    if (!conf_node_exists (app->conf, "pool.lend_idle_clients") || conf_get_boolean (app->conf, "pool.lend_idle_clients")) {
+        client_pool_add_lender (app->ops_client_pool, app->read_client_pool);
+        client_pool_add_lender (app->ops_client_pool, app->write_client_pool);
+        client_pool_add_lender (app->read_client_pool, app->write_client_pool);
+    }
+/*}}}*/
+
+/*{{{ WorkerPool */
+    app->worker_pool = worker_pool_create (app,
+        conf_node_exists (app->conf, "pool.workers") ? conf_get_int (app->conf, "pool.workers") : 2);
+    if (!app->worker_pool) {
+        LOG_err (APP_LOG, "Failed to create WorkerPool !");
+        application_exit (app);
+        return -1;
+    }
 /*}}}*/
 
 /*{{{ CacheMng */
@@ -558,6 +597,11 @@ static void application_destroy (Application *app)
     LOG_debug (APP_LOG, "Destroying application !");
 
     g_free (app->conf_path);
+
+    // wait for the running tasks first
+    if (app->worker_pool)
+        worker_pool_destroy (app->worker_pool);
+
     if (app->read_client_pool)
         client_pool_destroy (app->read_client_pool);
     if (app->write_client_pool)
@@ -690,6 +734,9 @@ int main (int argc, char *argv[])
     };
 
     // init libraries
+#if !GLIB_CHECK_VERSION(2, 32, 0)
+    g_thread_init (NULL);
+#endif
     CRYPTO_set_mem_functions (g_malloc0, g_realloc, g_free);
     ENGINE_load_builtin_engines ();
     ENGINE_register_all_complete ();
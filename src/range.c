@@ -18,7 +18,8 @@
 #include "range.h"
 
 struct _Range {
-    GList *l_intervals; // sorted list of intervals
+    GArray *a_intervals; // sorted array of non-overlapping intervals
+    guint64 length; // total length of all intervals
 };
 
 typedef struct {
@@ -26,140 +27,189 @@ typedef struct {
     guint64 end;
 } Interval;
 
+#define range_interval(range, i) (&g_array_index ((range)->a_intervals, Interval, (i)))
+
 Range *range_create ()
 {
     Range *range;
 
     range = g_new0 (Range, 1);
-    range->l_intervals = NULL;
+    range->a_intervals = g_array_new (FALSE, FALSE, sizeof (Interval));
+    range->length = 0;
 
     return range;
 }
 
 void range_destroy (Range *range)
 {
-    GList *l;
+    g_array_free (range->a_intervals, TRUE);
+    g_free (range);
+}
+
+// returns index of the first interval which ends at or after "pos"
+static guint range_find_end (Range *range, guint64 pos)
+{
+    guint lo = 0, hi = range->a_intervals->len;
+
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
 
-    for (l = g_list_first (range->l_intervals); l; l = g_list_next (l)) {
-        Interval *in = (Interval *) l->data;
-        g_free (in);
+        if (range_interval (range, mid)->end < pos)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
-    g_list_free (range->l_intervals);
-    g_free (range);
+
+    return lo;
 }
 
-static gint intervals_compare (Interval *a, Interval *b)
+// returns index of the first interval which starts after "pos"
+static guint range_find_start (Range *range, guint64 pos)
 {
-    if (a->start < b->start)
-        return -1;
-    else if (a->start > b->start)
-        return 1;
-    else
-        return 0;
+    guint lo = 0, hi = range->a_intervals->len;
+
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+
+        if (range_interval (range, mid)->start <= pos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+// replaces intervals [lo, hi) with "in"
+static void range_replace (Range *range, guint lo, guint hi, Interval *in)
+{
+    guint i;
+
+    for (i = lo; i < hi; i++)
+        range->length -= range_interval (range, i)->end - range_interval (range, i)->start;
+
+    if (lo < hi)
+        g_array_remove_range (range->a_intervals, lo, hi - lo);
+
+    if (in) {
+        g_array_insert_val (range->a_intervals, lo, *in);
+        range->length += in->end - in->start;
+    }
 }
 
 void range_add (Range *range, guint64 start, guint64 end)
 {
-    GList *l;
-    gboolean found = FALSE;
+    Interval in;
+    guint lo, hi;
 
-    l = g_list_first (range->l_intervals);
-    while (l) {
-        Interval *in = (Interval *) l->data;
+    g_assert (start <= end);
 
+    // intervals which overlap or touch [start, end]
+    lo = range_find_end (range, start);
+    hi = range_find_start (range, end);
+
+    in.start = start;
+    in.end = end;
+    if (lo < hi) {
         // is in range
-        if (in->start <= start && in->end >= end) {
+        if (hi - lo == 1 && range_interval (range, lo)->start <= start && range_interval (range, lo)->end >= end)
             return;
-        }
-
-        // overlaps
-        if ((in->start >= start && in->start <= end) || (in->end >= start && in->end <= end)) {
-            GList *j;
-            found = TRUE;
-            // extend it
-            if (in->end < end)
-                in->end = end;
-            if (in->start > start)
-                in->start = start;
-
-
-            j = l->next;
-            while (j) {
-                // extend
-                Interval *in1 = (Interval *) j->data;
-                if ((in->start >= in1->start && in->start <= in1->end) ||
-                    (in->end >= in1->start && in->end <= in1->end) ||
-                    (in->start <= in1->start && in->end >= in1->end)) {
-                    GList *l_save;
-
-                    if (in->end < in1->end)
-                        in->end = in1->end;
-                    if (in->start > in1->start)
-                        in->start = in1->start;
-
-                    l_save = j->next;
-                    range->l_intervals = g_list_delete_link (range->l_intervals, j);
-                    j = l_save;
-
-                    g_free (in1);
-                } else
-                    j = j->next;
-            }
-        }
-
-        l = l->next;
-    }
 
-    // not found
-    if (!found) {
-        Interval *in = g_new0 (Interval, 1);
-        in->start = start;
-        in->end = end;
-        range->l_intervals = g_list_insert_sorted (range->l_intervals, in, (GCompareFunc) intervals_compare);
+        // extend it
+        in.start = MIN (start, range_interval (range, lo)->start);
+        in.end = MAX (end, range_interval (range, hi - 1)->end);
     }
+
+    range_replace (range, lo, hi, &in);
 }
 
-gboolean range_contain (Range *range, guint64 start, guint64 end)
+void range_remove (Range *range, guint64 start, guint64 end)
 {
-    GList *l;
+    Interval left, right;
+    gboolean has_left, has_right;
+    guint lo, hi;
+
+    if (start >= end)
+        return;
+
+    // intervals which overlap [start, end)
+    lo = range_find_end (range, start + 1);
+    hi = range_find_start (range, end - 1);
+    if (lo >= hi)
+        return;
+
+    // trim or split
+    left.start = range_interval (range, lo)->start;
+    left.end = start;
+    has_left = left.start < start;
+    right.start = end;
+    right.end = range_interval (range, hi - 1)->end;
+    has_right = right.end > end;
+
+    range_replace (range, lo, hi, has_right ? &right : NULL);
+    if (has_left)
+        range_replace (range, lo, lo, &left);
+}
 
-    for (l = g_list_first (range->l_intervals); l; l = g_list_next (l)) {
-        Interval *in = (Interval *) l->data;
+gboolean range_contain (Range *range, guint64 start, guint64 end)
+{
+    guint i;
 
-        if (in->start <= start && in->end >= end)
-            return TRUE;
-    }
+    // the last interval which starts at or before "start"
+    i = range_find_start (range, start);
+    if (!i)
+        return FALSE;
 
-    return FALSE;
+    return range_interval (range, i - 1)->end >= end;
 }
 
 gint range_count (Range *range)
 {
-    return g_list_length (range->l_intervals);
+    return range->a_intervals->len;
 }
 
 guint64 range_length (Range *range)
 {
-    GList *l;
-    guint64 length = 0;
-
-    for (l = g_list_first (range->l_intervals); l; l = g_list_next (l)) {
-        Interval *in = (Interval *) l->data;
-
-        g_assert (in->start <= in->end);
-        length += in->end - in->start;
-    }
-
-    return length;
+    return range->length;
 }
 
 void range_print (Range *range)
 {
-    GList *l;
+    guint i;
 
     g_printf ("===\n");
-    for (l = g_list_first (range->l_intervals); l; l = g_list_next (l)) {
-        Interval *in = (Interval *) l->data;
+    for (i = 0; i < range->a_intervals->len; i++) {
+        Interval *in = range_interval (range, i);
         g_printf ("[%"G_GUINT64_FORMAT" %"G_GUINT64_FORMAT"]\n", in->start, in->end);
     }
 }
+
+void range_foreach (Range *range, Range_foreach_cb foreach_cb, gpointer ctx)
+{
+    guint i;
+
+    for (i = 0; i < range->a_intervals->len; i++) {
+        Interval *in = range_interval (range, i);
+        foreach_cb (in->start, in->end, ctx);
+    }
+}
+
+void range_foreach_missing (Range *range, guint64 start, guint64 end, Range_foreach_cb foreach_cb, gpointer ctx)
+{
+    guint64 pos = start;
+    guint i;
+
+    for (i = range_find_end (range, start + 1); i < range->a_intervals->len && pos < end; i++) {
+        Interval *in = range_interval (range, i);
+
+        if (in->start >= end)
+            break;
+        if (in->start > pos)
+            foreach_cb (pos, in->start, ctx);
+        if (in->end > pos)
+            pos = in->end;
+    }
+
+    if (pos < end)
+        foreach_cb (pos, end, ctx);
+}
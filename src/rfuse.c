@@ -33,14 +33,10 @@ struct _RFuse {
     // the event that we use to receive requests
     struct event *ev;
     struct event *ev_timer;
-#if FUSE_USE_VERSION >= 30
-    struct fuse_buf fbuf;
-#else
     // what our receive-message length is
     size_t recv_size;
     // the buffer that we use to receive events
     char *recv_buf;
-#endif
 
     // did we receive the destroy message?
     gboolean destroyed;
@@ -51,6 +47,10 @@ struct _RFuse {
     pthread_t *unmount_thread;
 #endif
 
+    // kernel cache invalidations are sent from a dedicated thread, started on the first request
+    GAsyncQueue *q_notify;
+    GThread *notify_thread;
+
     // statistics
     guint64 read_ops;
     guint64 write_ops;
@@ -60,9 +60,19 @@ struct _RFuse {
     // owner of filesystem, -1 to use the default value
     gint uid;
     gint gid;
+
+    // how long the kernel may cache attributes and directory entries (seconds)
+    gdouble attr_timeout;
+    gdouble entry_timeout;
+
+    // negotiated with the kernel, 0 to keep the default value
+    gboolean async_read;
+    guint max_readahead;
+    guint max_write;
 };
 
 #define FUSE_LOG "fuse"
+// default attributes and entry timeouts (seconds)
 #define ENTRY_TIMEOUT 1.0
 #define ATTR_TIMEOUT 1.0
 /*}}}*/
@@ -98,6 +108,7 @@ static void rfuse_statfs (fuse_req_t req, fuse_ino_t ino);
 static void rfuse_symlink (fuse_req_t req, const char *link, fuse_ino_t parent_ino, const char *name);
 static void rfuse_readlink (fuse_req_t req, fuse_ino_t ino);
 static void rfuse_flush (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi);
+static void rfuse_notify_stop (RFuse *rfuse);
 
 static struct fuse_lowlevel_ops rfuse_opers = {
     .init       = rfuse_init,
@@ -136,7 +147,8 @@ RFuse *rfuse_new (Application *app, const gchar *mountpoint, const gchar *fuse_o
     RFuse *rfuse;
     //struct timeval tv;
     struct fuse_args args = FUSE_ARGS_INIT (0, NULL);
-    gchar *opts;
+    gchar *opts, *base_opts;
+    guint max_read = 0;
 
     rfuse = g_new0 (RFuse, 1);
     rfuse->app = app;
@@ -147,6 +159,8 @@ RFuse *rfuse_new (Application *app, const gchar *mountpoint, const gchar *fuse_o
     rfuse->unmount_thread = NULL;
 #endif
     rfuse->read_ops = rfuse->write_ops = rfuse->readdir_ops = rfuse->lookup_ops = 0;
+    rfuse->q_notify = g_async_queue_new ();
+    rfuse->notify_thread = NULL;
 
     rfuse->uid = conf_get_int (application_get_conf (app), "filesystem.uid");
     rfuse->gid = conf_get_int (application_get_conf (app), "filesystem.gid");
@@ -156,10 +170,33 @@ RFuse *rfuse_new (Application *app, const gchar *mountpoint, const gchar *fuse_o
     if (rfuse->gid < 0)
         rfuse->gid = getgid ();
 
+    rfuse->attr_timeout = ATTR_TIMEOUT;
+    if (conf_node_exists (application_get_conf (app), "filesystem.attr_timeout"))
+        rfuse->attr_timeout = conf_get_uint (application_get_conf (app), "filesystem.attr_timeout");
+    rfuse->entry_timeout = ENTRY_TIMEOUT;
+    if (conf_node_exists (application_get_conf (app), "filesystem.entry_timeout"))
+        rfuse->entry_timeout = conf_get_uint (application_get_conf (app), "filesystem.entry_timeout");
+
+    rfuse->async_read = TRUE;
+    if (conf_node_exists (application_get_conf (app), "filesystem.async_read"))
+        rfuse->async_read = conf_get_boolean (application_get_conf (app), "filesystem.async_read");
+    if (conf_node_exists (application_get_conf (app), "filesystem.max_readahead"))
+        rfuse->max_readahead = conf_get_uint (application_get_conf (app), "filesystem.max_readahead");
+    if (conf_node_exists (application_get_conf (app), "filesystem.max_write"))
+        rfuse->max_write = conf_get_uint (application_get_conf (app), "filesystem.max_write");
+    if (conf_node_exists (application_get_conf (app), "filesystem.max_read"))
+        max_read = conf_get_uint (application_get_conf (app), "filesystem.max_read");
+
+    if (max_read)
+        base_opts = g_strdup_printf ("default_permissions,max_read=%u", max_read);
+    else
+        base_opts = g_strdup ("default_permissions");
+
     if (fuse_opts)
-        opts = g_strdup_printf ("default_permissions,%s", fuse_opts);
+        opts = g_strdup_printf ("%s,%s", base_opts, fuse_opts);
     else
-        opts = g_strdup ("default_permissions");
+        opts = g_strdup (base_opts);
+    g_free (base_opts);
 
     if (fuse_opt_add_arg (&args, "riofs") == -1) {
         LOG_err (FUSE_LOG, "Failed to parse FUSE parameter !");
@@ -185,9 +222,6 @@ RFuse *rfuse_new (Application *app, const gchar *mountpoint, const gchar *fuse_o
     rfuse->mounted = TRUE;
     fuse_opt_free_args (&args);
 
-#if FUSE_USE_VERSION >= 30
-    rfuse->fbuf.mem = NULL;
-#else
     // the receive buffer stuff
     rfuse->recv_size = fuse_chan_bufsize (rfuse->chan);
 
@@ -196,7 +230,6 @@ RFuse *rfuse_new (Application *app, const gchar *mountpoint, const gchar *fuse_o
         LOG_err (FUSE_LOG, "Failed to allocate memory !");
         return NULL;
     }
-#endif
 
     // allocate a low-level session
     rfuse->session = fuse_lowlevel_new (NULL, &rfuse_opers, sizeof (rfuse_opers), rfuse);
@@ -248,13 +281,12 @@ void rfuse_destroy (RFuse *rfuse)
     }
 #endif
 
+    rfuse_notify_stop (rfuse);
+    g_async_queue_unref (rfuse->q_notify);
+
     g_free (rfuse->mountpoint);
 
-#if FUSE_USE_VERSION >= 30
-    free (rfuse->fbuf.mem);
-#else
     g_free (rfuse->recv_buf);
-#endif
     event_free (rfuse->ev);
     fuse_session_destroy (rfuse->session);
     g_free (rfuse);
@@ -324,10 +356,33 @@ static void rfuse_on_timer (evutil_socket_t fd, short what, void *arg)
 }
 */
 
-// turn ASYNC read off
-static void rfuse_init (G_GNUC_UNUSED void *userdata, struct fuse_conn_info *conn)
+// negotiate connection parameters, the kernel may lower them further
+static void rfuse_init (void *userdata, struct fuse_conn_info *conn)
 {
-    conn->async_read = 0;
+    RFuse *rfuse = (RFuse *) userdata;
+
+    // several reads of the same file can be in flight, replies may come out of order
+    if (!rfuse->async_read)
+        conn->async_read = 0;
+
+    if (rfuse->max_readahead)
+        conn->max_readahead = rfuse->max_readahead;
+
+    // libfuse sets the largest value its receive buffer can hold
+    if (rfuse->max_write && rfuse->max_write < conn->max_write)
+        conn->max_write = rfuse->max_write;
+#ifdef FUSE_CAP_BIG_WRITES
+    // otherwise the kernel splits writes into pages
+    if (conn->max_write > 4096)
+        conn->want |= conn->capable & FUSE_CAP_BIG_WRITES;
+#endif
+
+    LOG_debug (FUSE_LOG, "FUSE connection, async_read: %u, max_readahead: %u, max_write: %u",
+        conn->async_read, conn->max_readahead, conn->max_write);
+#ifdef FUSE_SPLICE_ENABLED
+    // move data between /dev/fuse and cache files without copying it to user space
+    conn->want |= conn->capable & (FUSE_CAP_SPLICE_READ | FUSE_CAP_SPLICE_WRITE | FUSE_CAP_SPLICE_MOVE);
+#endif
 }
 
 static void rfuse_dest (void *userdata)
@@ -343,6 +398,9 @@ static void rfuse_on_read (G_GNUC_UNUSED evutil_socket_t fd, G_GNUC_UNUSED short
 {
     RFuse *rfuse = (RFuse *)arg;
     struct fuse_chan *ch = rfuse->chan;
+#ifdef FUSE_SPLICE_ENABLED
+    struct fuse_buf fbuf;
+#endif
     int res;
 
     if (!ch) {
@@ -358,8 +416,12 @@ static void rfuse_on_read (G_GNUC_UNUSED evutil_socket_t fd, G_GNUC_UNUSED short
     // loop until we complete a recv
     do {
         // a new fuse_req is available
-#if FUSE_USE_VERSION >= 30
-        res = fuse_session_receive_buf (rfuse->session, &rfuse->fbuf, ch);
+#ifdef FUSE_SPLICE_ENABLED
+        // request data might be left in the kernel pipe, "recv_buf" is used otherwise
+        memset (&fbuf, 0, sizeof (fbuf));
+        fbuf.mem = rfuse->recv_buf;
+        fbuf.size = rfuse->recv_size;
+        res = fuse_session_receive_buf (rfuse->session, &fbuf, &ch);
 #else
         res = fuse_chan_recv (&ch, rfuse->recv_buf, rfuse->recv_size);
 #endif
@@ -374,8 +436,8 @@ static void rfuse_on_read (G_GNUC_UNUSED evutil_socket_t fd, G_GNUC_UNUSED short
     if (res > 0) {
      //   LOG_debug (FUSE_LOG, "got %d bytes from /dev/fuse", res);
 
-#if FUSE_USE_VERSION >= 30
-        fuse_session_process_buf (rfuse->session, &rfuse->fbuf, ch);
+#ifdef FUSE_SPLICE_ENABLED
+        fuse_session_process_buf (rfuse->session, &fbuf, ch);
 #else
         fuse_session_process (rfuse->session, rfuse->recv_buf, res, ch);
 #endif
@@ -503,7 +565,7 @@ static void rfuse_getattr_cb (fuse_req_t req, gboolean success, fuse_ino_t ino,
     if (rfuse->gid >= 0)
         stbuf.st_gid = rfuse->gid;
 
-    fuse_reply_attr (req, &stbuf, 1.0);
+    fuse_reply_attr (req, &stbuf, rfuse->attr_timeout);
 }
 
 // FUSE lowlevel operation: getattr
@@ -540,7 +602,7 @@ static void rfuse_setattr_cb (fuse_req_t req, gboolean success, fuse_ino_t ino,
     if (rfuse->gid >= 0)
         stbuf.st_gid = rfuse->gid;
 
-    fuse_reply_attr (req, &stbuf, 1.0);
+    fuse_reply_attr (req, &stbuf, rfuse->attr_timeout);
 }
 
 // FUSE lowlevel operation: setattr
@@ -569,8 +631,8 @@ static void rfuse_lookup_cb (fuse_req_t req, gboolean success, fuse_ino_t ino, i
 
     memset(&e, 0, sizeof(e));
     e.ino = ino;
-    e.attr_timeout = ATTR_TIMEOUT;
-    e.entry_timeout = ENTRY_TIMEOUT;
+    e.attr_timeout = rfuse->attr_timeout;
+    e.entry_timeout = rfuse->entry_timeout;
 
     e.attr.st_ino = ino;
     e.attr.st_mode = mode;
@@ -638,8 +700,8 @@ void rfuse_create_cb (fuse_req_t req, gboolean success, fuse_ino_t ino, int mode
 
     memset(&e, 0, sizeof(e));
     e.ino = ino;
-    e.attr_timeout = ATTR_TIMEOUT;
-    e.entry_timeout = ENTRY_TIMEOUT;
+    e.attr_timeout = rfuse->attr_timeout;
+    e.entry_timeout = rfuse->entry_timeout;
 
     e.attr.st_ino = ino;
     e.attr.st_mode = mode;
@@ -697,8 +759,30 @@ static void rfuse_read_cb (fuse_req_t req, gboolean success, const char *buf, si
     fuse_reply_buf (req, buf, buf_size);
 }
 
+#ifdef FUSE_SPLICE_ENABLED
+// read callback, data is spliced from the cache file,
+// executed in a worker thread: the cache doesn't touch the range until it returns
+static void rfuse_read_fd_cb (fuse_req_t req, int fd, off_t off, size_t size)
+{
+    struct fuse_bufvec bufv = FUSE_BUFVEC_INIT (size);
+
+    LOG_debug (FUSE_LOG, "[req: %p] <<<<< read_cb  fd: %d, off: %"OFF_FMT", size: %zu", (void *)req, fd, off, size);
+
+    if (fd < 0) {
+        fuse_reply_err (req, EIO);
+        return;
+    }
+
+    bufv.buf[0].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+    bufv.buf[0].fd = fd;
+    bufv.buf[0].pos = off;
+
+    fuse_reply_data (req, &bufv, FUSE_BUF_SPLICE_MOVE);
+}
+#endif
+
 // FUSE lowlevel operation: read
-// Valid replies: fuse_reply_buf() fuse_reply_err()
+// Valid replies: fuse_reply_buf() fuse_reply_data() fuse_reply_err()
 static void rfuse_read (fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info *fi)
 {
     RFuse *rfuse = fuse_req_userdata (req);
@@ -706,7 +790,11 @@ static void rfuse_read (fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
     LOG_debug (FUSE_LOG, INO_FI_H">>>> read  inode, size: %zu, off: %"OFF_FMT, INO_T (ino), (void *)fi, size, off);
 
     rfuse->read_ops++;
-    dir_tree_file_read (rfuse->dir_tree, ino, size, off, rfuse_read_cb, req, fi);
+#ifdef FUSE_SPLICE_ENABLED
+    dir_tree_file_read (rfuse->dir_tree, ino, size, off, rfuse_read_cb, rfuse_read_fd_cb, req, fi);
+#else
+    dir_tree_file_read (rfuse->dir_tree, ino, size, off, rfuse_read_cb, NULL, req, fi);
+#endif
 }
 /*}}}*/
 
@@ -805,8 +893,8 @@ static void rfuse_mkdir_cb (fuse_req_t req, gboolean success, fuse_ino_t ino, in
 
     memset(&e, 0, sizeof(e));
     e.ino = ino;
-    e.attr_timeout = ATTR_TIMEOUT;
-    e.entry_timeout = ENTRY_TIMEOUT;
+    e.attr_timeout = rfuse->attr_timeout;
+    e.entry_timeout = rfuse->entry_timeout;
     e.attr.st_mode = mode;
     e.attr.st_nlink = 1;
     e.attr.st_ctime = ctime;
@@ -930,6 +1018,107 @@ static void rfuse_getxattr_cb (fuse_req_t req, gboolean success, fuse_ino_t ino,
 }
 /*}}}*/
 
+/*{{{ invalidation */
+typedef struct {
+    fuse_ino_t ino; // parent inode for entry invalidation
+    gchar *name; // NULL for inode invalidation
+    gboolean stop; // terminates the notification thread
+} RFuseNotify;
+
+static void rfuse_notify_free (RFuseNotify *notify)
+{
+    g_free (notify->name);
+    g_free (notify);
+}
+
+// the kernel may wait for a reply to a pending request of the same inode,
+// so notifications must never block the event loop or the worker pool (cache I/O)
+static gpointer rfuse_notify_thread (gpointer ctx)
+{
+    RFuse *rfuse = (RFuse *) ctx;
+    RFuseNotify *notify;
+    int res;
+
+    while ((notify = g_async_queue_pop (rfuse->q_notify)) && !notify->stop) {
+#if FUSE_VERSION >= 28
+        if (notify->name)
+            res = fuse_lowlevel_notify_inval_entry (rfuse->chan, notify->ino, notify->name, strlen (notify->name));
+        else
+            res = fuse_lowlevel_notify_inval_inode (rfuse->chan, notify->ino, 0, 0);
+#else
+        res = -ENOSYS;
+#endif
+
+        // the kernel doesn't know about this inode or entry
+        if (res && res != -ENOENT)
+            LOG_debug (FUSE_LOG, INO_H"Failed to invalidate kernel cache: %s", INO_T (notify->ino), strerror (-res));
+
+        rfuse_notify_free (notify);
+    }
+
+    rfuse_notify_free (notify);
+
+    return NULL;
+}
+
+static void rfuse_notify (RFuse *rfuse, fuse_ino_t ino, const gchar *name)
+{
+    RFuseNotify *notify;
+
+    if (!rfuse || !rfuse->mounted || !rfuse->chan)
+        return;
+
+    if (!rfuse->notify_thread) {
+#if GLIB_CHECK_VERSION(2, 32, 0)
+        rfuse->notify_thread = g_thread_try_new ("notify", rfuse_notify_thread, rfuse, NULL);
+#else
+        rfuse->notify_thread = g_thread_create (rfuse_notify_thread, rfuse, TRUE, NULL);
+#endif
+        if (!rfuse->notify_thread) {
+            LOG_err (FUSE_LOG, INO_H"Failed to start kernel cache invalidation thread !", INO_T (ino));
+            return;
+        }
+    }
+
+    notify = g_new0 (RFuseNotify, 1);
+    notify->ino = ino;
+    notify->name = g_strdup (name);
+
+    g_async_queue_push (rfuse->q_notify, notify);
+}
+
+// drop pending notifications and wait for the thread to exit
+static void rfuse_notify_stop (RFuse *rfuse)
+{
+    RFuseNotify *notify;
+
+    if (!rfuse->notify_thread)
+        return;
+
+    while ((notify = g_async_queue_try_pop (rfuse->q_notify)))
+        rfuse_notify_free (notify);
+
+    notify = g_new0 (RFuseNotify, 1);
+    notify->stop = TRUE;
+    g_async_queue_push (rfuse->q_notify, notify);
+
+    g_thread_join (rfuse->notify_thread);
+    rfuse->notify_thread = NULL;
+}
+
+void rfuse_inval_inode (RFuse *rfuse, fuse_ino_t ino)
+{
+    LOG_debug (FUSE_LOG, INO_H"Invalidating kernel cache", INO_T (ino));
+    rfuse_notify (rfuse, ino, NULL);
+}
+
+void rfuse_inval_entry (RFuse *rfuse, fuse_ino_t parent_ino, const gchar *name)
+{
+    LOG_debug (FUSE_LOG, INO_H"Invalidating kernel entry: %s", INO_T (parent_ino), name);
+    rfuse_notify (rfuse, parent_ino, name);
+}
+/*}}}*/
+
 /*{{{ get_stats */
 void rfuse_get_stats (RFuse *rfuse, guint64 *read_ops, guint64 *write_ops, guint64 *readdir_ops, guint64 *lookup_ops)
 {
@@ -975,8 +1164,8 @@ static void rfuse_symlik_cb (fuse_req_t req, gboolean success, fuse_ino_t ino, i
 
     memset(&e, 0, sizeof(e));
     e.ino = ino;
-    e.attr_timeout = ATTR_TIMEOUT;
-    e.entry_timeout = ENTRY_TIMEOUT;
+    e.attr_timeout = rfuse->attr_timeout;
+    e.entry_timeout = rfuse->entry_timeout;
 
     e.attr.st_ino = ino;
     e.attr.st_mode = mode;
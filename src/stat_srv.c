@@ -125,6 +125,8 @@ static void stat_srv_on_stats_cb (struct evhttp_request *req, void *ctx)
     guint64 read_ops, write_ops, readdir_ops, lookup_ops;
     guint32 cache_entries;
     guint64 total_cache_size, cache_hits, cache_miss;
+    const gchar *cache_policy;
+    guint64 ghost_hits, ghost_miss;
     struct tm *cur_p;
     struct tm cur;
     time_t now;
@@ -181,6 +183,9 @@ static void stat_srv_on_stats_cb (struct evhttp_request *req, void *ctx)
     g_string_append_printf (str, "<BR>CacheMng: <BR>-Total entries: %"G_GUINT32_FORMAT", Total cache size: %"G_GUINT64_FORMAT
         " bytes, Cache hits: %"G_GUINT64_FORMAT", Cache misses: %"G_GUINT64_FORMAT" <BR>",
         cache_entries, total_cache_size, cache_hits, cache_miss);
+    cache_mng_get_policy_stats (application_get_cache_mng (stat_srv->app), &cache_policy, &ghost_hits, &ghost_miss);
+    g_string_append_printf (str, "-Eviction policy: %s, Ghost hits: %"G_GUINT64_FORMAT", Ghost misses: %"G_GUINT64_FORMAT" <BR>",
+        cache_policy, ghost_hits, ghost_miss);
 
     g_string_append_printf (str, "<BR>Read workers (%d): <BR>",
         client_pool_get_client_count (application_get_read_client_pool (stat_srv->app)));
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2012-2014 Paul Ionkin <paul.ionkin@gmail.com>
+ * Copyright (C) 2012-2014 Skoobe GmbH. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "worker_pool.h"
+
+/*{{{ struct */
+struct _WorkerPool {
+    Application *app;
+    GThreadPool *thread_pool;
+    GAsyncQueue *q_done; // finished tasks, waiting for the event loop
+    int notify_fds[2]; // pipe to wake up the event loop
+    struct event *notify_ev;
+    guint tasks_pending; // pushed tasks which are not finished yet
+};
+
+typedef struct {
+    WorkerPool *wpool;
+    WorkerPool_task_cb task_cb;
+    WorkerPool_on_task_done_cb on_task_done_cb;
+    gpointer ctx;
+} WorkerTask;
+
+#define WPOOL_LOG "wpool"
+
+static void worker_pool_on_task_cb (gpointer data, gpointer user_data);
+static void worker_pool_on_notify_cb (evutil_socket_t fd, short what, void *ctx);
+/*}}}*/
+
+/*{{{ create / destroy */
+WorkerPool *worker_pool_create (Application *app, gint thread_count)
+{
+    WorkerPool *wpool;
+    GError *error = NULL;
+
+    wpool = g_new0 (WorkerPool, 1);
+    wpool->app = app;
+    wpool->q_done = g_async_queue_new ();
+    wpool->notify_fds[0] = wpool->notify_fds[1] = -1;
+
+    if (pipe (wpool->notify_fds) < 0) {
+        LOG_err (WPOOL_LOG, "Failed to create pipe: %s", strerror (errno));
+        worker_pool_destroy (wpool);
+        return NULL;
+    }
+    evutil_make_socket_nonblocking (wpool->notify_fds[0]);
+    evutil_make_socket_nonblocking (wpool->notify_fds[1]);
+
+    wpool->notify_ev = event_new (application_get_evbase (app), wpool->notify_fds[0], EV_READ | EV_PERSIST,
+        worker_pool_on_notify_cb, wpool);
+
+    wpool->thread_pool = g_thread_pool_new (worker_pool_on_task_cb, wpool, thread_count, FALSE, &error);
+    if (!wpool->thread_pool) {
+        LOG_err (WPOOL_LOG, "Failed to create thread pool: %s", error ? error->message : "");
+        if (error)
+            g_error_free (error);
+        worker_pool_destroy (wpool);
+        return NULL;
+    }
+
+    LOG_debug (WPOOL_LOG, "Worker pool created, threads: %d", thread_count);
+
+    return wpool;
+}
+
+void worker_pool_destroy (WorkerPool *wpool)
+{
+    WorkerTask *task;
+
+    // wait for the running tasks
+    if (wpool->thread_pool) {
+        g_thread_pool_free (wpool->thread_pool, TRUE, TRUE);
+        wpool->thread_pool = NULL;
+    }
+
+    // finished tasks release their contexts in the completion callbacks
+    while ((task = g_async_queue_try_pop (wpool->q_done))) {
+        wpool->tasks_pending--;
+        task->on_task_done_cb (task->ctx);
+        g_free (task);
+    }
+    g_async_queue_unref (wpool->q_done);
+
+    if (wpool->notify_ev)
+        event_free (wpool->notify_ev);
+    if (wpool->notify_fds[0] >= 0)
+        close (wpool->notify_fds[0]);
+    if (wpool->notify_fds[1] >= 0)
+        close (wpool->notify_fds[1]);
+
+    g_free (wpool);
+}
+/*}}}*/
+
+/*{{{ tasks */
+// executed in a worker thread
+static void worker_pool_on_task_cb (gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+    WorkerTask *task = (WorkerTask *) data;
+    char c = 0;
+
+    task->task_cb (task->ctx);
+
+    g_async_queue_push (task->wpool->q_done, task);
+
+    // wake up the event loop
+    // if the pipe is full, the event loop is already notified
+    if (write (task->wpool->notify_fds[1], &c, 1) < 0) {
+        return;
+    }
+}
+
+// executed in the event loop thread
+static void worker_pool_on_notify_cb (evutil_socket_t fd, G_GNUC_UNUSED short what, void *ctx)
+{
+    WorkerPool *wpool = (WorkerPool *) ctx;
+    WorkerTask *task;
+    char buf[64];
+
+    while (read (fd, buf, sizeof (buf)) > 0);
+
+    while ((task = g_async_queue_try_pop (wpool->q_done))) {
+        wpool->tasks_pending--;
+        task->on_task_done_cb (task->ctx);
+        g_free (task);
+    }
+
+    // do not keep the event loop running if there is nothing to wait for
+    if (!wpool->tasks_pending)
+        event_del (wpool->notify_ev);
+}
+
+gboolean worker_pool_push (WorkerPool *wpool,
+    WorkerPool_task_cb task_cb, WorkerPool_on_task_done_cb on_task_done_cb, gpointer ctx)
+{
+    WorkerTask *task;
+    GError *error = NULL;
+
+    // the pool is being destroyed
+    if (!wpool->thread_pool)
+        return FALSE;
+
+    task = g_new0 (WorkerTask, 1);
+    task->wpool = wpool;
+    task->task_cb = task_cb;
+    task->on_task_done_cb = on_task_done_cb;
+    task->ctx = ctx;
+
+    if (!g_thread_pool_push (wpool->thread_pool, task, &error)) {
+        LOG_err (WPOOL_LOG, "Failed to push task: %s", error ? error->message : "");
+        if (error)
+            g_error_free (error);
+        g_free (task);
+        return FALSE;
+    }
+
+    if (!wpool->tasks_pending++)
+        event_add (wpool->notify_ev, NULL);
+
+    return TRUE;
+}
+/*}}}*/
@@ -55,11 +55,20 @@ static void retrieve_cb (unsigned char *buf, size_t size, gboolean success, void
     }
 }
 
+static void missing_cb (guint64 start, guint64 end, void *ctx)
+{
+    guint64 *missing = (guint64 *) ctx;
+
+    missing[0]++;
+    missing[1] += end - start;
+}
+
 static void cache_mng_test_store (CacheMng **cmng, gconstpointer test_data)
 {
     struct test_ctx test_ctx = {FALSE, NULL, 0};
     int i;
     unsigned char buf[256];
+    guint64 missing[2];
 
     for (i = 0; i < (int) sizeof (buf); i++)
         buf[i] = i % 256;
@@ -71,6 +80,16 @@ static void cache_mng_test_store (CacheMng **cmng, gconstpointer test_data)
 
     g_assert (test_ctx.success);
     g_assert (cache_mng_size (*cmng) == 25);
+    g_assert (cache_mng_has_range (*cmng, 1, 25, 0));
+    g_assert (!cache_mng_has_range (*cmng, 1, 26, 0));
+    g_assert (!cache_mng_has_range (*cmng, 2, 1, 0));
+
+    memset (missing, 0, sizeof (missing));
+    cache_mng_foreach_missing (*cmng, 1, 50, 0, missing_cb, missing);
+    g_assert (missing[0] == 1 && missing[1] == 25);
+    memset (missing, 0, sizeof (missing));
+    cache_mng_foreach_missing (*cmng, 2, 50, 0, missing_cb, missing);
+    g_assert (missing[0] == 1 && missing[1] == 50);
 
     cache_mng_retrieve_file_buf (*cmng, 1, 25, 0, retrieve_cb, &test_ctx);
     app_dispatch (app);
@@ -82,6 +101,169 @@ static void cache_mng_test_store (CacheMng **cmng, gconstpointer test_data)
     g_free (test_ctx.buf);
 }
 
+// repeated reads are served from the memory tier, which must see later writes
+static void cache_mng_test_memory (CacheMng **cmng, gconstpointer test_data)
+{
+    struct test_ctx test_ctx = {FALSE, NULL, 0};
+    int i;
+    unsigned char buf[256];
+
+    for (i = 0; i < (int) sizeof (buf); i++)
+        buf[i] = i % 256;
+
+    cache_mng_store_file_buf (*cmng, 1, sizeof (buf), 0, buf, store_cb, &test_ctx);
+    app_dispatch (app);
+    g_assert (test_ctx.success);
+
+    for (i = 0; i < 3; i++) {
+        cache_mng_retrieve_file_buf (*cmng, 1, sizeof (buf), 0, retrieve_cb, &test_ctx);
+        app_dispatch (app);
+
+        g_assert (test_ctx.success);
+        g_assert (test_ctx.buflen == sizeof (buf));
+        g_assert (memcmp (test_ctx.buf, buf, test_ctx.buflen) == 0);
+        g_free (test_ctx.buf);
+    }
+
+    memset (buf + 100, 0, 10);
+    cache_mng_store_file_buf (*cmng, 1, 10, 100, buf + 100, store_cb, &test_ctx);
+    cache_mng_retrieve_file_buf (*cmng, 1, sizeof (buf), 0, retrieve_cb, &test_ctx);
+    app_dispatch (app);
+
+    g_assert (test_ctx.success);
+    g_assert (test_ctx.buflen == sizeof (buf));
+    g_assert (memcmp (test_ctx.buf, buf, test_ctx.buflen) == 0);
+    g_free (test_ctx.buf);
+}
+
+struct fd_ctx {
+    unsigned char buf[256];
+    ssize_t res;
+    gint started;
+    gint evicted;
+};
+
+// executed in a worker thread
+static void read_fd_cb (void *ctx, int fd, off_t off, size_t size)
+{
+    struct fd_ctx *fd_ctx = (struct fd_ctx *) ctx;
+    int i;
+
+    g_atomic_int_set (&fd_ctx->started, 1);
+
+    // wait for the block to be evicted
+    for (i = 0; i < 1000 && !g_atomic_int_get (&fd_ctx->evicted); i++)
+        g_usleep (1000);
+
+    if (fd < 0) {
+        fd_ctx->res = -1;
+        return;
+    }
+    fd_ctx->res = pread (fd, fd_ctx->buf, MIN (size, sizeof (fd_ctx->buf)), off);
+}
+
+// data read once is passed as a file descriptor, data read again is moved to the memory tier
+static void cache_mng_test_fd (CacheMng **cmng, gconstpointer test_data)
+{
+    struct test_ctx test_ctx = {FALSE, NULL, 0};
+    struct fd_ctx fd_ctx = {{0}, 0, 0, 1};
+    int i;
+    unsigned char buf[256];
+
+    for (i = 0; i < (int) sizeof (buf); i++)
+        buf[i] = i % 256;
+
+    // not written yet
+    cache_mng_store_file_buf (*cmng, 1, sizeof (buf), 0, buf, store_cb, &test_ctx);
+    g_assert (!cache_mng_read_file_fd (*cmng, 1, sizeof (buf), 0, read_fd_cb, &fd_ctx));
+    app_dispatch (app);
+    g_assert (test_ctx.success);
+
+    g_assert (cache_mng_read_file_fd (*cmng, 1, sizeof (buf), 0, read_fd_cb, &fd_ctx));
+    // the first read is queued yet
+    g_assert (!cache_mng_read_file_fd (*cmng, 1, sizeof (buf), 0, read_fd_cb, &fd_ctx));
+    app_dispatch (app);
+    g_assert (fd_ctx.res == sizeof (buf));
+    g_assert (memcmp (fd_ctx.buf, buf, sizeof (buf)) == 0);
+
+    cache_mng_retrieve_file_buf (*cmng, 1, sizeof (buf), 0, retrieve_cb, &test_ctx);
+    app_dispatch (app);
+    g_assert (test_ctx.success);
+    g_free (test_ctx.buf);
+
+    // served from memory
+    g_assert (!cache_mng_read_file_fd (*cmng, 1, sizeof (buf), 0, read_fd_cb, &fd_ctx));
+    g_assert (!cache_mng_read_file_fd (*cmng, 2, sizeof (buf), 0, read_fd_cb, &fd_ctx));
+}
+
+// the block is released only after the pending read by the file descriptor
+static void cache_mng_test_fd_evict (CacheMng **cmng, gconstpointer test_data)
+{
+    struct test_ctx test_ctx = {FALSE, NULL, 0};
+    struct fd_ctx fd_ctx = {{0}, 0, 0, 0};
+    CacheMng *ecmng;
+    int i;
+    unsigned char buf[512];
+
+    for (i = 0; i < (int) sizeof (buf); i++)
+        buf[i] = (i * 3) % 256;
+
+    conf_set_uint (app->conf, "filesystem.cache_dir_max_size", 512);
+    conf_set_uint (app->conf, "filesystem.cache_block_size", 256);
+    conf_set_uint (app->conf, "filesystem.cache_high_watermark", 100);
+    ecmng = cache_mng_create (app);
+
+    cache_mng_store_file_buf (ecmng, 1, sizeof (buf), 0, buf, store_cb, &test_ctx);
+    app_dispatch (app);
+    g_assert (test_ctx.success);
+
+    g_assert (cache_mng_read_file_fd (ecmng, 1, 256, 0, read_fd_cb, &fd_ctx));
+    for (i = 0; i < 1000 && !g_atomic_int_get (&fd_ctx.started); i++)
+        g_usleep (1000);
+    g_assert (g_atomic_int_get (&fd_ctx.started));
+
+    // the second block is used more recently, the first one is evicted
+    cache_mng_store_file_buf (ecmng, 1, 256, 256, buf + 256, store_cb, &test_ctx);
+    cache_mng_store_file_buf (ecmng, 2, 256, 0, buf, store_cb, &test_ctx);
+    g_assert (!cache_mng_has_range (ecmng, 1, 256, 0));
+    g_atomic_int_set (&fd_ctx.evicted, 1);
+    app_dispatch (app);
+
+    g_assert (test_ctx.success);
+    g_assert (fd_ctx.res == 256);
+    g_assert (memcmp (fd_ctx.buf, buf, 256) == 0);
+    g_assert (!cache_mng_has_range (ecmng, 1, 256, 0));
+    g_assert (cache_mng_has_range (ecmng, 1, 256, 256));
+    cache_mng_destroy (ecmng);
+
+    conf_set_uint (app->conf, "filesystem.cache_block_size", 0);
+    conf_set_uint (app->conf, "filesystem.cache_high_watermark", 100);
+    conf_set_uint (app->conf, "filesystem.cache_dir_max_size", 1024 * 1024 * 1024);
+}
+
+// small sequential writes are merged while the disk is busy
+static void cache_mng_test_coalesce (CacheMng **cmng, gconstpointer test_data)
+{
+    struct test_ctx test_ctx = {FALSE, NULL, 0};
+    int i;
+    unsigned char buf[1024];
+
+    for (i = 0; i < (int) sizeof (buf); i++)
+        buf[i] = (i * 7) % 256;
+
+    for (i = 0; i < (int) sizeof (buf); i += 16)
+        cache_mng_store_file_buf (*cmng, 1, 16, i, buf + i, NULL, NULL);
+    g_assert (cache_mng_size (*cmng) == sizeof (buf));
+
+    cache_mng_retrieve_file_buf (*cmng, 1, sizeof (buf), 0, retrieve_cb, &test_ctx);
+    app_dispatch (app);
+
+    g_assert (test_ctx.success);
+    g_assert (test_ctx.buflen == sizeof (buf));
+    g_assert (memcmp (test_ctx.buf, buf, test_ctx.buflen) == 0);
+    g_free (test_ctx.buf);
+}
+
 static void cache_mng_test_remove (CacheMng **cmng, gconstpointer test_data)
 {
     struct test_ctx test_ctx = {FALSE, NULL, 0};
@@ -109,31 +291,150 @@ static void cache_mng_test_remove (CacheMng **cmng, gconstpointer test_data)
 static void cache_mng_test_lru (CacheMng **cmng, gconstpointer test_data)
 {
     struct test_ctx test_ctx = {FALSE, NULL, 0};
+    CacheMng *lcmng;
     int i;
     unsigned char buf[512];
 
     for (i = 0; i < (int) sizeof (buf); i++)
         buf[i] = i % 256;
 
-    cache_mng_store_file_buf (*cmng, 1, sizeof (buf), 0, buf, store_cb, &test_ctx);
-    cache_mng_store_file_buf (*cmng, 2, sizeof (buf), 0, buf, store_cb, &test_ctx);
-    cache_mng_retrieve_file_buf (*cmng, 1, 1, 0, retrieve_cb, &test_ctx);
+    // only the hard limit applies
+    conf_set_uint (app->conf, "filesystem.cache_dir_max_size", 1024);
+    conf_set_uint (app->conf, "filesystem.cache_high_watermark", 100);
+    lcmng = cache_mng_create (app);
+
+    cache_mng_store_file_buf (lcmng, 1, sizeof (buf), 0, buf, store_cb, &test_ctx);
+    cache_mng_store_file_buf (lcmng, 2, sizeof (buf), 0, buf, store_cb, &test_ctx);
+    cache_mng_retrieve_file_buf (lcmng, 1, 1, 0, retrieve_cb, &test_ctx);
     app_dispatch (app);
 
     g_assert (test_ctx.success);
-    g_assert (cache_mng_size (*cmng) == 1024);
+    g_assert (cache_mng_size (lcmng) == 1024);
     g_free (test_ctx.buf);
 
-    cache_mng_store_file_buf (*cmng, 3, sizeof (buf), 0, buf, store_cb, &test_ctx);
+    cache_mng_store_file_buf (lcmng, 3, sizeof (buf), 0, buf, store_cb, &test_ctx);
     app_dispatch (app);
 
     g_assert (test_ctx.success);
-    g_assert (cache_mng_size (*cmng) == 1024);
+    g_assert (cache_mng_size (lcmng) == 1024);
 
-    cache_mng_retrieve_file_buf (*cmng, 2, 1, 0, retrieve_cb, &test_ctx);
+    cache_mng_retrieve_file_buf (lcmng, 2, 1, 0, retrieve_cb, &test_ctx);
     app_dispatch (app);
 
     g_assert (!test_ctx.success);
+
+    // overwriting cached data does not evict anything
+    cache_mng_store_file_buf (lcmng, 3, 100, 0, buf, store_cb, &test_ctx);
+    app_dispatch (app);
+    g_assert (cache_mng_has_range (lcmng, 1, sizeof (buf), 0));
+    cache_mng_destroy (lcmng);
+
+    conf_set_uint (app->conf, "filesystem.cache_dir_max_size", 1024 * 1024 * 1024);
+}
+
+// a single pass over many files does not evict files which are read repeatedly
+static void cache_mng_test_s3fifo (CacheMng **cmng, gconstpointer test_data)
+{
+    struct test_ctx test_ctx = {FALSE, NULL, 0};
+    CacheMng *scmng;
+    int i;
+    unsigned char buf[200];
+
+    memset (buf, 1, sizeof (buf));
+
+    conf_set_uint (app->conf, "filesystem.cache_dir_max_size", 1000);
+    conf_set_uint (app->conf, "filesystem.cache_high_watermark", 100);
+    conf_set_string (app->conf, "filesystem.cache_eviction_policy", "s3fifo");
+    scmng = cache_mng_create (app);
+
+    for (i = 1; i <= 2; i++) {
+        cache_mng_store_file_buf (scmng, i, sizeof (buf), 0, buf, store_cb, &test_ctx);
+        cache_mng_retrieve_file_buf (scmng, i, 1, 0, retrieve_cb, &test_ctx);
+        app_dispatch (app);
+        g_assert (test_ctx.success);
+        g_free (test_ctx.buf);
+    }
+
+    for (i = 3; i <= 20; i++) {
+        cache_mng_store_file_buf (scmng, i, sizeof (buf), 0, buf, store_cb, &test_ctx);
+        app_dispatch (app);
+        g_assert (test_ctx.success);
+        g_assert (cache_mng_size (scmng) <= 1000);
+    }
+
+    g_assert (cache_mng_has_range (scmng, 1, sizeof (buf), 0));
+    g_assert (cache_mng_has_range (scmng, 2, sizeof (buf), 0));
+    g_assert (cache_mng_has_range (scmng, 20, sizeof (buf), 0));
+    g_assert (!cache_mng_has_range (scmng, 3, sizeof (buf), 0));
+    cache_mng_destroy (scmng);
+
+    conf_set_string (app->conf, "filesystem.cache_eviction_policy", "lru");
+    conf_set_uint (app->conf, "filesystem.cache_dir_max_size", 1024 * 1024 * 1024);
+}
+
+// background eviction starts above the high watermark and stops below the low one
+static void cache_mng_test_watermark (CacheMng **cmng, gconstpointer test_data)
+{
+    struct test_ctx test_ctx = {FALSE, NULL, 0};
+    CacheMng *wcmng;
+    int i;
+    unsigned char buf[200];
+
+    memset (buf, 1, sizeof (buf));
+
+    conf_set_uint (app->conf, "filesystem.cache_dir_max_size", 1000);
+    conf_set_uint (app->conf, "filesystem.cache_high_watermark", 90);
+    conf_set_uint (app->conf, "filesystem.cache_low_watermark", 50);
+    wcmng = cache_mng_create (app);
+
+    for (i = 1; i <= 4; i++)
+        cache_mng_store_file_buf (wcmng, i, sizeof (buf), 0, buf, store_cb, &test_ctx);
+    app_dispatch (app);
+    g_assert (cache_mng_size (wcmng) == 800);
+
+    cache_mng_store_file_buf (wcmng, 5, sizeof (buf), 0, buf, store_cb, &test_ctx);
+    app_dispatch (app);
+    g_assert (test_ctx.success);
+    g_assert (cache_mng_size (wcmng) == 400);
+    g_assert (!cache_mng_has_range (wcmng, 1, sizeof (buf), 0));
+    g_assert (cache_mng_has_range (wcmng, 5, sizeof (buf), 0));
+    cache_mng_destroy (wcmng);
+
+    conf_set_uint (app->conf, "filesystem.cache_high_watermark", 100);
+    conf_set_uint (app->conf, "filesystem.cache_low_watermark", 100);
+    conf_set_uint (app->conf, "filesystem.cache_dir_max_size", 1024 * 1024 * 1024);
+}
+
+static void pending_cb (gboolean success, void *ctx)
+{
+    gint *calls = (gint *) ctx;
+
+    g_assert (success);
+    (*calls)++;
+}
+
+static void cache_mng_test_pending (CacheMng **cmng, gconstpointer test_data)
+{
+    gint calls = 0;
+
+    cache_mng_pending_add (*cmng, 1, 100, 0);
+    cache_mng_pending_add (*cmng, 1, 100, 100);
+
+    g_assert (cache_mng_pending_exists (*cmng, 1, 10, 90));
+    g_assert (!cache_mng_pending_exists (*cmng, 1, 20, 90));
+    g_assert (!cache_mng_pending_exists (*cmng, 2, 10, 0));
+
+    g_assert (cache_mng_pending_wait (*cmng, 1, 10, 10, pending_cb, &calls));
+    g_assert (cache_mng_pending_wait (*cmng, 1, 50, 50, pending_cb, &calls));
+    g_assert (!cache_mng_pending_wait (*cmng, 1, 10, 195, pending_cb, &calls));
+
+    cache_mng_pending_done (*cmng, 1, 100, 100, TRUE);
+    g_assert_cmpint (calls, ==, 0);
+    g_assert (!cache_mng_pending_exists (*cmng, 1, 10, 100));
+
+    cache_mng_pending_done (*cmng, 1, 100, 0, TRUE);
+    g_assert_cmpint (calls, ==, 2);
+    g_assert (!cache_mng_pending_exists (*cmng, 1, 10, 0));
 }
 
 static void cache_mng_test_zero_size (CacheMng **cmng, gconstpointer test_data)
@@ -154,15 +455,168 @@ static void cache_mng_test_zero_size (CacheMng **cmng, gconstpointer test_data)
     g_assert (test_ctx.buf == NULL);
 }
 
+static void cache_mng_test_persistent (CacheMng **cmng, gconstpointer test_data)
+{
+    struct test_ctx test_ctx = {FALSE, NULL, 0};
+    CacheMng *pcmng;
+    int i;
+    unsigned char buf[256];
+
+    for (i = 0; i < (int) sizeof (buf); i++)
+        buf[i] = i % 256;
+
+    conf_set_boolean (app->conf, "filesystem.cache_persistent", TRUE);
+
+    pcmng = cache_mng_create (app);
+    cache_mng_set_file_path (pcmng, 1, "/file", FALSE);
+    cache_mng_store_file_buf (pcmng, 1, 100, 0, buf, store_cb, &test_ctx);
+    cache_mng_update_etag (pcmng, 1, "\"etag\"");
+    app_dispatch (app);
+    g_assert (test_ctx.success);
+    cache_mng_destroy (pcmng);
+
+    // inode numbers are different after remount
+    pcmng = cache_mng_create (app);
+    g_assert (cache_mng_size (pcmng) == 100);
+    g_assert (!cache_mng_has_range (pcmng, 2, 100, 0));
+    cache_mng_set_file_path (pcmng, 2, "/file", FALSE);
+    g_assert (cache_mng_has_range (pcmng, 2, 100, 0));
+    g_assert_cmpstr (cache_mng_get_etag (pcmng, 2), ==, "\"etag\"");
+
+    cache_mng_retrieve_file_buf (pcmng, 2, 50, 10, retrieve_cb, &test_ctx);
+    app_dispatch (app);
+    g_assert (test_ctx.success);
+    g_assert (test_ctx.buflen == 50);
+    g_assert (memcmp (test_ctx.buf, buf + 10, test_ctx.buflen) == 0);
+    g_free (test_ctx.buf);
+    cache_mng_destroy (pcmng);
+
+    // overwritten file
+    pcmng = cache_mng_create (app);
+    cache_mng_set_file_path (pcmng, 3, "/file", TRUE);
+    g_assert (!cache_mng_has_range (pcmng, 3, 1, 0));
+    g_assert (cache_mng_size (pcmng) == 0);
+    cache_mng_destroy (pcmng);
+
+    conf_set_boolean (app->conf, "filesystem.cache_persistent", FALSE);
+}
+
+// the second mount does not use the persistent cache of the first one
+static void cache_mng_test_persistent_lock (CacheMng **cmng, gconstpointer test_data)
+{
+    struct test_ctx test_ctx = {FALSE, NULL, 0};
+    CacheMng *pcmng, *scmng;
+    unsigned char buf[100];
+
+    memset (buf, 1, sizeof (buf));
+    conf_set_boolean (app->conf, "filesystem.cache_persistent", TRUE);
+
+    pcmng = cache_mng_create (app);
+    scmng = cache_mng_create (app);
+    g_assert (scmng);
+    cache_mng_set_file_path (scmng, 1, "/locked", FALSE);
+    cache_mng_store_file_buf (scmng, 1, sizeof (buf), 0, buf, store_cb, &test_ctx);
+    app_dispatch (app);
+    g_assert (test_ctx.success);
+    cache_mng_destroy (scmng);
+    cache_mng_destroy (pcmng);
+
+    pcmng = cache_mng_create (app);
+    cache_mng_set_file_path (pcmng, 1, "/locked", FALSE);
+    g_assert (!cache_mng_has_range (pcmng, 1, 1, 0));
+    cache_mng_destroy (pcmng);
+
+    conf_set_boolean (app->conf, "filesystem.cache_persistent", FALSE);
+}
+
+// a file which is being written keeps its path and ETag when its blocks are evicted to make room
+static void cache_mng_test_persistent_evict (CacheMng **cmng, gconstpointer test_data)
+{
+    struct test_ctx test_ctx = {FALSE, NULL, 0};
+    CacheMng *pcmng;
+    unsigned char buf[512];
+
+    memset (buf, 1, sizeof (buf));
+    conf_set_boolean (app->conf, "filesystem.cache_persistent", TRUE);
+    conf_set_uint (app->conf, "filesystem.cache_dir_max_size", 1024);
+    conf_set_uint (app->conf, "filesystem.cache_high_watermark", 100);
+
+    pcmng = cache_mng_create (app);
+    cache_mng_set_file_path (pcmng, 1, "/pinned", TRUE);
+    cache_mng_store_file_buf (pcmng, 1, sizeof (buf), 0, buf, store_cb, &test_ctx);
+    cache_mng_update_etag (pcmng, 1, "\"etag\"");
+    cache_mng_store_file_buf (pcmng, 2, sizeof (buf), 0, buf, store_cb, &test_ctx);
+    app_dispatch (app);
+    g_assert (test_ctx.success);
+
+    // the only block of the file is evicted
+    cache_mng_store_file_buf (pcmng, 1, sizeof (buf), sizeof (buf), buf, store_cb, &test_ctx);
+    app_dispatch (app);
+    g_assert (test_ctx.success);
+    g_assert (!cache_mng_has_range (pcmng, 1, 1, 0));
+    g_assert (cache_mng_has_range (pcmng, 1, sizeof (buf), sizeof (buf)));
+    g_assert_cmpstr (cache_mng_get_etag (pcmng, 1), ==, "\"etag\"");
+    cache_mng_destroy (pcmng);
+
+    conf_set_uint (app->conf, "filesystem.cache_dir_max_size", 1024 * 1024 * 1024);
+    pcmng = cache_mng_create (app);
+    cache_mng_set_file_path (pcmng, 3, "/pinned", FALSE);
+    g_assert (cache_mng_has_range (pcmng, 3, sizeof (buf), sizeof (buf)));
+    cache_mng_destroy (pcmng);
+
+    conf_set_boolean (app->conf, "filesystem.cache_persistent", FALSE);
+}
+
+// the file of a removed entry is deleted after its disk operations, they don't create it again
+static void cache_mng_test_remove_pending (CacheMng **cmng, gconstpointer test_data)
+{
+    struct test_ctx test_ctx = {FALSE, NULL, 0};
+    CacheMng *pcmng;
+    unsigned char buf[100];
+    gchar *name, *path;
+
+    memset (buf, 1, sizeof (buf));
+    conf_set_boolean (app->conf, "filesystem.cache_persistent", TRUE);
+
+    name = g_compute_checksum_for_string (G_CHECKSUM_MD5, "/removed", -1);
+    path = g_strdup_printf ("%s/persistent/%s", conf_get_string (app->conf, "filesystem.cache_dir"), name);
+
+    pcmng = cache_mng_create (app);
+    cache_mng_set_file_path (pcmng, 1, "/removed", TRUE);
+    cache_mng_store_file_buf (pcmng, 1, sizeof (buf), 0, buf, store_cb, &test_ctx);
+    cache_mng_store_file_buf (pcmng, 1, sizeof (buf), sizeof (buf), buf, store_cb, &test_ctx);
+    cache_mng_remove_file (pcmng, 1);
+    app_dispatch (app);
+
+    g_assert (!test_ctx.success);
+    g_assert (!g_file_test (path, G_FILE_TEST_EXISTS));
+    cache_mng_destroy (pcmng);
+
+    g_free (name);
+    g_free (path);
+    conf_set_boolean (app->conf, "filesystem.cache_persistent", FALSE);
+}
+
 int main (int argc, char *argv[])
 {
     app = app_create ();
     g_test_init (&argc, &argv, NULL);
 
     g_test_add ("/cache_mng/cache_mng_test_store", CacheMng *, 0, cache_mng_test_setup, cache_mng_test_store, cache_mng_test_destroy);
+    g_test_add ("/cache_mng/cache_mng_test_memory", CacheMng *, 0, cache_mng_test_setup, cache_mng_test_memory, cache_mng_test_destroy);
+    g_test_add ("/cache_mng/cache_mng_test_fd", CacheMng *, 0, cache_mng_test_setup, cache_mng_test_fd, cache_mng_test_destroy);
+    g_test_add ("/cache_mng/cache_mng_test_fd_evict", CacheMng *, 0, cache_mng_test_setup, cache_mng_test_fd_evict, cache_mng_test_destroy);
+    g_test_add ("/cache_mng/cache_mng_test_coalesce", CacheMng *, 0, cache_mng_test_setup, cache_mng_test_coalesce, cache_mng_test_destroy);
     g_test_add ("/cache_mng/cache_mng_test_remove", CacheMng *, 0, cache_mng_test_setup, cache_mng_test_remove, cache_mng_test_destroy);
     g_test_add ("/cache_mng/cache_mng_test_lru", CacheMng *, 0, cache_mng_test_setup, cache_mng_test_lru, cache_mng_test_destroy);
+    g_test_add ("/cache_mng/cache_mng_test_s3fifo", CacheMng *, 0, cache_mng_test_setup, cache_mng_test_s3fifo, cache_mng_test_destroy);
+    g_test_add ("/cache_mng/cache_mng_test_watermark", CacheMng *, 0, cache_mng_test_setup, cache_mng_test_watermark, cache_mng_test_destroy);
+    g_test_add ("/cache_mng/cache_mng_test_pending", CacheMng *, 0, cache_mng_test_setup, cache_mng_test_pending, cache_mng_test_destroy);
     g_test_add ("/cache_mng/cache_mng_test_zero_size", CacheMng *, 0, cache_mng_test_setup, cache_mng_test_zero_size, cache_mng_test_destroy);
+    g_test_add ("/cache_mng/cache_mng_test_persistent", CacheMng *, 0, cache_mng_test_setup, cache_mng_test_persistent, cache_mng_test_destroy);
+    g_test_add ("/cache_mng/cache_mng_test_persistent_lock", CacheMng *, 0, cache_mng_test_setup, cache_mng_test_persistent_lock, cache_mng_test_destroy);
+    g_test_add ("/cache_mng/cache_mng_test_persistent_evict", CacheMng *, 0, cache_mng_test_setup, cache_mng_test_persistent_evict, cache_mng_test_destroy);
+    g_test_add ("/cache_mng/cache_mng_test_remove_pending", CacheMng *, 0, cache_mng_test_setup, cache_mng_test_remove_pending, cache_mng_test_destroy);
 
     return g_test_run ();
 }
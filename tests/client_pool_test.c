@@ -19,218 +19,405 @@
 #include "test_application.h"
 #include "http_connection.h"
 #include "client_pool.h"
-#include "utils.h"
 
-#define POOL_TEST "pool_test"
+// fake client: busy from the moment it's passed to a request until fake_release ()
 typedef struct {
-    gchar *in_name;
-    gchar *md5;
-    gchar *url;
-
-    gchar *out_name;
-    FILE *fout;
-
-    gboolean checked;
-    GList *l;
-} FileData;
-
-typedef struct {
-    ClientPool *pool;
-    GList *l_files;
-} CBData;
+    gboolean busy;
+    ClientPool_on_released_cb on_released_cb;
+    gpointer pool_ctx;
+} FakeClient;
 
 static Application *app;
+// clients passed to requests and not released yet, in order of start
+static GQueue *q_running;
+// names of the served requests, in order of start
+static GString *served;
 
-// create max_files and fill with random data
-// return list of {file name, content md5}
-static GList *populate_file_list (gint max_files, GList *l_files, gchar *in_dir)
+static gpointer fake_create (G_GNUC_UNUSED Application *app)
 {
-    gint i;
-    gchar *out_dir;
-    GError *error = NULL;
-    FileData *fdata;
-    gchar *name;
-    FILE *f;
-
-    out_dir = g_dir_make_tmp (NULL, &error);
-    g_assert (out_dir);
-
-
-    LOG_debug (POOL_TEST, "In dir: %s   Out dir: %s", in_dir, out_dir);
-
-    for (i = 0; i < max_files; i++) {
-        char *bytes;
-        size_t bytes_len;
-
-        fdata = g_new0 (FileData, 1);
-        fdata->checked = FALSE;
-        bytes_len = g_random_int_range (100000, 1000000);
-        bytes = g_malloc (bytes_len + 1);
-        RAND_bytes ((unsigned char *)bytes, bytes_len);
-        *(bytes + bytes_len) = '\0';
-
-        name = get_random_string (15, TRUE);
-        fdata->in_name = g_strdup_printf ("%s/%s", in_dir, name);
-        f = fopen (fdata->in_name, "w");
-        fwrite (bytes, 1, bytes_len + 1, f);
-        fclose (f);
-
-        fdata->out_name = g_strdup_printf ("%s/%s", out_dir, name);
-        get_md5_sum (bytes, bytes_len + 1, &fdata->md5, NULL);
+    return g_new0 (FakeClient, 1);
+}
 
-        fdata->fout = fopen (fdata->out_name, "w");
-        g_assert (fdata->fout);
+static void fake_destroy (gpointer client)
+{
+    g_free (client);
+}
 
-        fdata->url = g_strdup_printf ("http://127.0.0.1:8011/%s", name);
-        g_assert (fdata->url);
+static void fake_set_on_released_cb (gpointer client, ClientPool_on_released_cb on_released_cb, gpointer ctx)
+{
+    FakeClient *fc = (FakeClient *) client;
 
-        LOG_debug (POOL_TEST, "%s -> %s, size: %u", fdata->in_name, fdata->md5, bytes_len);
+    fc->on_released_cb = on_released_cb;
+    fc->pool_ctx = ctx;
+}
 
-        l_files = g_list_append (l_files, fdata);
-    }
+static gboolean fake_check_rediness (gpointer client)
+{
+    FakeClient *fc = (FakeClient *) client;
 
-    return l_files;
+    return !fc->busy;
 }
 
-gboolean check_list (GList *l)
+static void fake_get_stats_info (G_GNUC_UNUSED gpointer client, G_GNUC_UNUSED GString *str,
+    G_GNUC_UNUSED struct PrintFormat *print_format)
 {
-    GList *tmp;
+}
 
-    for (tmp = g_list_first (l); tmp; tmp = g_list_next (tmp)) {
-        FileData *fdata = (FileData *) tmp->data;
-        if (!fdata->checked)
-            return FALSE;
-    }
-    return TRUE;
+static ClientPool *fake_pool_create (gint client_count)
+{
+    return client_pool_create (app, client_count,
+        fake_create,
+        fake_destroy,
+        fake_set_on_released_cb,
+        fake_check_rediness,
+        fake_get_stats_info,
+        fake_get_stats_info
+    );
 }
 
-static void on_output_timer (evutil_socket_t fd, short event, void *ctx)
+static void fake_release (FakeClient *fc)
 {
-    gint i;
-    GList *l;
+    fc->busy = FALSE;
+    fc->on_released_cb (fc, fc->pool_ctx);
+}
 
-    CBData *cb = (CBData *) ctx;
-    ClientPool *pool = cb->pool;
+static void on_client_ready (gpointer client, gpointer ctx)
+{
+    FakeClient *fc = (FakeClient *) client;
 
-    for (l = g_list_first (cb->l_files); l; l = g_list_next (l)) {
-        FileData *fd = (FileData *) l->data;
-      //  g_assert (s3client_pool_get_client (pool, on_get_http_client, fd));
-    }
+    fc->busy = TRUE;
+    g_queue_push_tail (q_running, fc);
+    if (ctx)
+        g_string_append (served, (const gchar *) ctx);
 }
 
-#define BUFFER_SIZE 1024 * 10
-
-static void on_srv_request (struct evhttp_request *req, void *ctx)
+static void release_client (FakeClient *fc)
 {
-    struct evbuffer *in;
-    gchar *dir = (gchar *) ctx;
-    gchar *path, *decoded_path;
-    const gchar *tmp;
-    const char *uri = evhttp_request_get_uri(req);
-    struct evhttp_uri *decoded = NULL;
-    struct evbuffer *evb = NULL;
-    char buf[BUFFER_SIZE];
-    FILE *f;
-    size_t bytes_read;
-    size_t total_bytes = 0;
+    g_queue_remove (q_running, fc);
+    fake_release (fc);
+}
 
-    in = evhttp_request_get_input_buffer (req);
+// releases running clients until all requests are served
+static void release_all ()
+{
+    FakeClient *fc;
 
-    decoded = evhttp_uri_parse(uri);
-    g_assert (decoded);
-    tmp = evhttp_uri_get_path (decoded);
-    g_assert (tmp);
-    decoded_path = evhttp_uridecode(tmp, 0, NULL);
+    while ((fc = g_queue_pop_head (q_running)))
+        fake_release (fc);
+}
 
-    evb = evbuffer_new();
+// returns the number of requests which run in parallel when "count" requests are made at once
+static guint count_parallel (ClientPool *pool, guint count)
+{
+    guint i, running;
 
-    path = g_strdup_printf ("%s/%s", dir, decoded_path);
-    LOG_debug (POOL_TEST, "SRV: received %d bytes. Req: %s, path: %s", evbuffer_get_length (in), evhttp_request_get_uri (req), path);
+    for (i = 0; i < count; i++)
+        g_assert (client_pool_get_client_prio (pool, CLIENT_POOL_PRIO_READ, on_client_ready, NULL));
+    running = g_queue_get_length (q_running);
+    release_all ();
 
-    f = fopen (path, "r");
-    g_assert (f);
+    return running;
+}
 
-    while ((bytes_read = fread (buf, 1, BUFFER_SIZE, f)) > 0) {
-        evbuffer_add (evb, buf, bytes_read);
-        total_bytes += bytes_read;
-    }
-    evhttp_send_reply(req, 200, "OK", evb);
+// returns the client's context which is passed to client_pool_on_request_feedback ()
+static gpointer get_feedback_ctx (ClientPool *pool)
+{
+    FakeClient *fc;
+    gpointer ctx;
 
-    LOG_debug (POOL_TEST, "Total bytes sent: %u", total_bytes);
+    g_assert (client_pool_get_client_prio (pool, CLIENT_POOL_PRIO_READ, on_client_ready, NULL));
+    fc = g_queue_peek_head (q_running);
+    ctx = fc->pool_ctx;
+    release_all ();
 
-    fclose(f);
-    evbuffer_free(evb);
+    return ctx;
 }
 
-static void start_srv (struct event_base *base, gchar *in_dir)
+// waits for the beginning of the next second, so a few calls are made within the same second
+static void wait_next_second ()
 {
-    struct evhttp *http;
+    time_t start = time (NULL);
 
-    http = evhttp_new (base);
-    evhttp_bind_socket (http, "127.0.0.1", 8011);
-    evhttp_set_gencb (http, on_srv_request, in_dir);
+    while (time (NULL) == start)
+        g_usleep (1000);
 }
 
+static void client_pool_test_setup (ClientPool **pool, gconstpointer test_data)
+{
+    q_running = g_queue_new ();
+    served = g_string_new (NULL);
+    *pool = NULL;
+}
 
-static gboolean print_foreach (gconstpointer a, gconstpointer b)
+static void client_pool_test_destroy (ClientPool **pool, gconstpointer test_data)
 {
-    g_printf ("%p: %i\n", a, GPOINTER_TO_INT (b));
-    return FALSE;
+    if (*pool)
+        client_pool_destroy (*pool);
+    g_queue_free (q_running);
+    g_string_free (served, TRUE);
 }
 
-int main (int argc, char *argv[])
+// a burst of throttled responses halves the window only once per interval
+static void client_pool_test_cwnd_decrease (ClientPool **pool, gconstpointer test_data)
 {
-    ClientPool *pool;
-    struct event *timeout;
-    struct timeval tv;
-    GList *l_files = NULL;
-    CBData *cb;
-    gchar *in_dir;
+    gpointer ctx;
+
+    *pool = fake_pool_create (8);
+    ctx = get_feedback_ctx (*pool);
+    g_assert_cmpuint (count_parallel (*pool, 10), ==, 8);
+
+    wait_next_second ();
+    client_pool_on_request_feedback (ctx, TRUE, 0);
+    client_pool_on_request_feedback (ctx, TRUE, 0);
+    client_pool_on_request_feedback (ctx, TRUE, 0);
+    g_assert_cmpuint (count_parallel (*pool, 10), ==, 4);
+
+    // the next interval
+    wait_next_second ();
+    client_pool_on_request_feedback (ctx, TRUE, 0);
+    g_assert_cmpuint (count_parallel (*pool, 10), ==, 2);
+
+    // never below one request
+    wait_next_second ();
+    client_pool_on_request_feedback (ctx, TRUE, 0);
+    wait_next_second ();
+    client_pool_on_request_feedback (ctx, TRUE, 0);
+    g_assert_cmpuint (count_parallel (*pool, 10), ==, 1);
+}
 
-    log_level = LOG_debug;
+// successful responses grow the window by one per window of requests, up to max_clients
+static void client_pool_test_cwnd_increase (ClientPool **pool, gconstpointer test_data)
+{
+    gpointer ctx;
+    gint i;
 
-    event_set_mem_functions (g_malloc, g_realloc, g_free);
+    *pool = fake_pool_create (2);
+    client_pool_set_max_clients (*pool, 4, 60);
+    ctx = get_feedback_ctx (*pool);
+    g_assert_cmpuint (count_parallel (*pool, 10), ==, 4);
+
+    wait_next_second ();
+    client_pool_on_request_feedback (ctx, TRUE, 0);
+    g_assert_cmpuint (count_parallel (*pool, 10), ==, 2);
+
+    // 2 -> 2.5 -> 2.9
+    client_pool_on_request_feedback (ctx, FALSE, 0);
+    client_pool_on_request_feedback (ctx, FALSE, 0);
+    g_assert_cmpuint (count_parallel (*pool, 10), ==, 2);
+    // -> 3.24
+    client_pool_on_request_feedback (ctx, FALSE, 0);
+    g_assert_cmpuint (count_parallel (*pool, 10), ==, 3);
+
+    for (i = 0; i < 100; i++)
+        client_pool_on_request_feedback (ctx, FALSE, 0);
+    g_assert_cmpuint (count_parallel (*pool, 10), ==, 4);
+
+    // the window didn't grow above max_clients, a single decrease halves it
+    wait_next_second ();
+    client_pool_on_request_feedback (ctx, TRUE, 0);
+    g_assert_cmpuint (count_parallel (*pool, 10), ==, 2);
+}
 
-    in_dir = g_dir_make_tmp (NULL, NULL);
-    g_assert (in_dir);
+// the pool doesn't grow while requests take much longer than usual
+static void client_pool_test_latency (ClientPool **pool, gconstpointer test_data)
+{
+    gpointer ctx;
+    gint i;
 
-    l_files = populate_file_list (100, l_files, in_dir);
-    g_assert (l_files);
+    *pool = fake_pool_create (1);
+    client_pool_set_max_clients (*pool, 4, 60);
+    ctx = get_feedback_ctx (*pool);
 
+    for (i = 0; i < 20; i++)
+        client_pool_on_request_feedback (ctx, FALSE, 20);
+    for (i = 0; i < 20; i++)
+        client_pool_on_request_feedback (ctx, FALSE, 200);
+    g_assert_cmpuint (count_parallel (*pool, 10), ==, 1);
+    g_assert_cmpint (client_pool_get_client_count (*pool), ==, 1);
 
+    // throttled requests don't change the average
+    client_pool_on_request_feedback (ctx, TRUE, 20);
+    g_assert_cmpuint (count_parallel (*pool, 10), ==, 1);
 
-    app = app_create ();
+    for (i = 0; i < 30; i++)
+        client_pool_on_request_feedback (ctx, FALSE, 20);
+    g_assert_cmpuint (count_parallel (*pool, 10), ==, 4);
+}
 
+// while all classes are waiting, they are served in proportion to their weights
+static void client_pool_test_stride (ClientPool **pool, gconstpointer test_data)
+{
+    gint i;
+    gint counts[4] = {0, 0, 0, 0};
 
+    *pool = fake_pool_create (1);
+    g_assert (client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_READ, on_client_ready, "R"));
 
-    app->h_clients_freq = g_hash_table_new (g_direct_hash, g_direct_equal);
-    app->l_files = l_files;
-    // start server
-    start_srv (app->evbase, in_dir);
+    // queued in reverse order of importance
+    for (i = 0; i < 8; i++) {
+        g_assert (client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_WRITEBACK, on_client_ready, "W"));
+        g_assert (client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_READAHEAD, on_client_ready, "A"));
+        g_assert (client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_READ, on_client_ready, "R"));
+        g_assert (client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_METADATA, on_client_ready, "M"));
+    }
+    g_assert_cmpstr (served->str, ==, "R");
+
+    release_all ();
+    g_assert_cmpuint (served->len, ==, 33);
+
+    // 8:4:2:1 in the first round, every class gets its turn
+    for (i = 1; i <= 15; i++) {
+        switch (served->str[i]) {
+            case 'M': counts[0]++; break;
+            case 'R': counts[1]++; break;
+            case 'A': counts[2]++; break;
+            case 'W': counts[3]++; break;
+        }
+    }
+    g_assert_cmpint (counts[0], ==, 8);
+    g_assert_cmpint (counts[1], ==, 4);
+    g_assert_cmpint (counts[2], ==, 2);
+    g_assert_cmpint (counts[3], ==, 1);
+    // the remaining requests of the lower classes go last
+    g_assert_cmpint (served->str[32], ==, 'W');
+}
 
-    /*
-    pool = client_pool_create (app, 12,
-        http_client_create,
-        http_client_destroy,
-        http_client_set_on_released_cb,
-        http_client_check_rediness
-    );
-    */
+// a queue which was empty doesn't get credit for the time it was idle
+static void client_pool_test_stride_idle (ClientPool **pool, gconstpointer test_data)
+{
+    gint i;
 
-    cb = g_new (CBData, 1);
-    cb->pool = pool;
-    cb->l_files = l_files;
+    *pool = fake_pool_create (1);
+    g_assert (client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_READ, on_client_ready, "R"));
+    for (i = 0; i < 8; i++)
+        g_assert (client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_READAHEAD, on_client_ready, "A"));
+    release_all ();
+    g_assert_cmpstr (served->str, ==, "RAAAAAAAA");
+
+    // readahead was served alone for a while, metadata requests which come now
+    // get their share, but don't take all turns to catch up
+    g_string_truncate (served, 0);
+    g_assert (client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_READ, on_client_ready, "R"));
+    for (i = 0; i < 8; i++)
+        g_assert (client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_METADATA, on_client_ready, "M"));
+    for (i = 0; i < 2; i++)
+        g_assert (client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_READAHEAD, on_client_ready, "A"));
+    release_all ();
+    g_assert_cmpstr (served->str, ==, "RMMMMMAMMMA");
+}
 
-    timeout = evtimer_new (app->evbase, on_output_timer, cb);
+// foreground requests use idle clients of the lender, background requests wait for their own pool
+static void client_pool_test_lend (ClientPool **pool, gconstpointer test_data)
+{
+    ClientPool *lender;
+    FakeClient *fc_own, *fc_lent;
+
+    *pool = fake_pool_create (1);
+    lender = fake_pool_create (1);
+    client_pool_add_lender (*pool, lender);
+
+    g_assert (client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_READ, on_client_ready, "1"));
+    fc_own = g_queue_peek_tail (q_running);
+    g_assert (client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_READAHEAD, on_client_ready, "2"));
+    g_assert (client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_METADATA, on_client_ready, "3"));
+    fc_lent = g_queue_peek_tail (q_running);
+    g_assert (fc_lent != fc_own);
+    g_assert (client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_READ, on_client_ready, "4"));
+    g_assert_cmpstr (served->str, ==, "13");
+
+    // the lender passes its client to the awaiting foreground request
+    release_client (fc_lent);
+    g_assert_cmpstr (served->str, ==, "134");
+    g_assert (g_queue_peek_tail (q_running) == fc_lent);
+
+    // but not to the readahead
+    release_client (fc_lent);
+    g_assert_cmpstr (served->str, ==, "134");
+
+    release_client (fc_own);
+    g_assert_cmpstr (served->str, ==, "1342");
+    release_all ();
+
+    // the lender's own requests go first
+    g_string_truncate (served, 0);
+    g_assert (client_pool_get_client_prio (lender, CLIENT_POOL_PRIO_READ, on_client_ready, "5"));
+    fc_lent = g_queue_peek_tail (q_running);
+    g_assert (client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_READ, on_client_ready, "6"));
+    fc_own = g_queue_peek_tail (q_running);
+    g_assert (client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_READ, on_client_ready, "7"));
+    g_assert (client_pool_get_client_prio (lender, CLIENT_POOL_PRIO_READ, on_client_ready, "8"));
+    release_client (fc_lent);
+    g_assert_cmpstr (served->str, ==, "568");
+    release_all ();
+    g_assert_cmpstr (served->str, ==, "5687");
+
+    client_pool_destroy (lender);
+}
 
-    evutil_timerclear(&tv);
-    tv.tv_sec = 0;
-    tv.tv_usec = 500;
-    event_add (timeout, &tv);
+// background requests can't fill the queue of a pool serving foreground requests
+static void client_pool_test_queue_reserve (ClientPool **pool, gconstpointer test_data)
+{
+    ClientPool *write_pool;
+    guint i;
+
+    *pool = fake_pool_create (1);
+    g_assert (client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_READ, on_client_ready, NULL));
+
+    for (i = 0; client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_READAHEAD, on_client_ready, NULL); i++);
+    g_assert_cmpuint (i, ==, 75);
+    for (i = 0; client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_READ, on_client_ready, NULL); i++);
+    g_assert_cmpuint (i, ==, 25);
+    g_assert (!client_pool_get_client_prio (*pool, CLIENT_POOL_PRIO_METADATA, on_client_ready, NULL));
+
+    // a pool of background requests uses the whole queue
+    write_pool = fake_pool_create (1);
+    client_pool_set_default_prio (write_pool, CLIENT_POOL_PRIO_WRITEBACK);
+    g_assert (client_pool_get_client (write_pool, on_client_ready, NULL));
+    for (i = 0; client_pool_get_client (write_pool, on_client_ready, NULL); i++);
+    g_assert_cmpuint (i, ==, 100);
+
+    client_pool_destroy (write_pool);
+    g_queue_clear (q_running);
+}
 
-    event_base_dispatch (app->evbase);
+// the retry delay is random, but never exceeds the exponential bound and max_retry_delay
+static void client_pool_test_retry_delay ()
+{
+    guint64 bound, delay;
+    gboolean reached_max = FALSE;
+    gint retry_id, i;
+
+    for (retry_id = 0; retry_id < 100; retry_id++) {
+        bound = MIN ((guint64) 100 << MIN (MAX (retry_id - 1, 0), 16), 20000);
+        for (i = 0; i < 100; i++) {
+            delay = http_connection_get_retry_delay (100, 20000, retry_id);
+            g_assert_cmpuint (delay, <=, bound);
+            if (delay > 10000)
+                reached_max = TRUE;
+        }
+    }
+    // the delay is spread up to the limit
+    g_assert (reached_max);
 
-    g_hash_table_foreach (app->h_clients_freq, (GHFunc)print_foreach, NULL);
+    g_assert_cmpuint (http_connection_get_retry_delay (0, 20000, 5), ==, 0);
+    g_assert_cmpuint (http_connection_get_retry_delay (100, 0, 5), ==, 0);
+    g_assert_cmpuint (http_connection_get_retry_delay (G_MAXUINT32, 1000, 1000), <=, 1000);
+}
 
-    return 0;
+int main (int argc, char *argv[])
+{
+    app = app_create ();
+    conf_set_uint (app->conf, "pool.max_requests_per_pool", 100);
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add ("/client_pool/client_pool_test_cwnd_decrease", ClientPool *, 0, client_pool_test_setup, client_pool_test_cwnd_decrease, client_pool_test_destroy);
+    g_test_add ("/client_pool/client_pool_test_cwnd_increase", ClientPool *, 0, client_pool_test_setup, client_pool_test_cwnd_increase, client_pool_test_destroy);
+    g_test_add ("/client_pool/client_pool_test_latency", ClientPool *, 0, client_pool_test_setup, client_pool_test_latency, client_pool_test_destroy);
+    g_test_add ("/client_pool/client_pool_test_stride", ClientPool *, 0, client_pool_test_setup, client_pool_test_stride, client_pool_test_destroy);
+    g_test_add ("/client_pool/client_pool_test_stride_idle", ClientPool *, 0, client_pool_test_setup, client_pool_test_stride_idle, client_pool_test_destroy);
+    g_test_add ("/client_pool/client_pool_test_lend", ClientPool *, 0, client_pool_test_setup, client_pool_test_lend, client_pool_test_destroy);
+    g_test_add ("/client_pool/client_pool_test_queue_reserve", ClientPool *, 0, client_pool_test_setup, client_pool_test_queue_reserve, client_pool_test_destroy);
+    g_test_add_func ("/client_pool/client_pool_test_retry_delay", client_pool_test_retry_delay);
+
+    return g_test_run ();
 }
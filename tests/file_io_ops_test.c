@@ -0,0 +1,491 @@
+/*
+ * Copyright (C) 2012-2014 Paul Ionkin <paul.ionkin@gmail.com>
+ * Copyright (C) 2012-2014 Skoobe GmbH. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "file_io_ops.h"
+#include "http_connection.h"
+#include "cache_mng.h"
+#include "test_application.h"
+
+// requests are not sent anywhere, the test replies to them
+typedef struct {
+    gchar *path;
+    gchar *method;
+    HttpConnection_response_cb response_cb;
+    gpointer ctx;
+} FakeRequest;
+
+struct write_ctx {
+    gint calls;
+    gboolean success;
+};
+
+struct read_ctx {
+    gint calls;
+    gboolean success;
+    size_t size;
+};
+
+static Application *app;
+static CacheMng *cmng;
+static HttpConnection *fake_con;
+static GQueue *q_requests;
+static gint fake_pool;
+static const gchar *fake_fail_path; // requests to this path fail to be created
+static ClientPoolPriority fake_last_prio; // priority of the last request for a client
+
+#define UPLOAD_XML "<InitiateMultipartUploadResult xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\">" \
+    "<UploadId>upload1</UploadId></InitiateMultipartUploadResult>"
+
+/*{{{ stubs */
+CacheMng *application_get_cache_mng (Application *app)
+{
+    return cmng;
+}
+
+DirTree *application_get_dir_tree (Application *app)
+{
+    return NULL;
+}
+
+RFuse *application_get_rfuse (Application *app)
+{
+    return NULL;
+}
+
+ClientPool *application_get_read_client_pool (Application *app)
+{
+    return (ClientPool *) &fake_pool;
+}
+
+ClientPool *application_get_write_client_pool (Application *app)
+{
+    return (ClientPool *) &fake_pool;
+}
+
+#ifdef MAGIC_ENABLED
+magic_t application_get_magic_ctx (Application *app)
+{
+    return NULL;
+}
+#endif
+
+gboolean dir_tree_get_entry_meta (DirTree *dtree, fuse_ino_t ino, guint64 *size, const gchar **etag)
+{
+    return FALSE;
+}
+
+void dir_tree_set_entry_exist (DirTree *dtree, fuse_ino_t ino)
+{
+}
+
+void dir_tree_set_entry_meta (DirTree *dtree, fuse_ino_t ino, guint64 size, const gchar *etag)
+{
+}
+
+void rfuse_inval_inode (RFuse *rfuse, fuse_ino_t ino)
+{
+}
+
+gboolean client_pool_get_client (ClientPool *pool, ClientPool_on_client_ready on_client_ready, gpointer ctx)
+{
+    on_client_ready (fake_con, ctx);
+    return TRUE;
+}
+
+gboolean client_pool_get_client_prio (ClientPool *pool, ClientPoolPriority prio,
+    ClientPool_on_client_ready on_client_ready, gpointer ctx)
+{
+    fake_last_prio = prio;
+    return client_pool_get_client (pool, on_client_ready, ctx);
+}
+
+gboolean http_connection_acquire (HttpConnection *con)
+{
+    return TRUE;
+}
+
+gboolean http_connection_release (HttpConnection *con)
+{
+    return TRUE;
+}
+
+void http_connection_add_output_header (HttpConnection *con, const gchar *key, const gchar *value)
+{
+}
+
+void http_connection_set_on_chunk_cb (HttpConnection *con, HttpConnection_on_chunk_cb chunk_cb)
+{
+}
+
+gboolean http_connection_make_request (HttpConnection *con,
+    const gchar *resource_path,
+    const gchar *http_cmd,
+    struct evbuffer *out_buffer,
+    gboolean enable_retry, gpointer parent_request_data,
+    HttpConnection_response_cb response_cb,
+    gpointer ctx)
+{
+    FakeRequest *req;
+
+    if (!g_strcmp0 (resource_path, fake_fail_path))
+        return FALSE;
+
+    req = g_new0 (FakeRequest, 1);
+    req->path = g_strdup (resource_path);
+    req->method = g_strdup (http_cmd);
+    req->response_cb = response_cb;
+    req->ctx = ctx;
+    g_queue_push_tail (q_requests, req);
+
+    return TRUE;
+}
+/*}}}*/
+
+/*{{{ helpers */
+// returns the oldest request which is not replied yet
+static FakeRequest *fake_pop (const gchar *method, const gchar *path)
+{
+    FakeRequest *req;
+
+    req = g_queue_pop_head (q_requests);
+    g_assert (req);
+    g_assert_cmpstr (req->method, ==, method);
+    g_assert_cmpstr (req->path, ==, path);
+
+    return req;
+}
+
+static void fake_reply (FakeRequest *req, gboolean success, const gchar *buf, size_t buf_len,
+    struct evkeyvalq *headers)
+{
+    struct evkeyvalq empty;
+
+    TAILQ_INIT (&empty);
+    req->response_cb (fake_con, req->ctx, success, buf, buf_len, headers ? headers : &empty);
+
+    g_free (req->path);
+    g_free (req->method);
+    g_free (req);
+}
+
+static void write_cb (FileIO *fop, gpointer ctx, gboolean success, size_t count)
+{
+    struct write_ctx *wctx = (struct write_ctx *) ctx;
+
+    wctx->calls++;
+    wctx->success = success;
+}
+
+static void read_cb (gpointer ctx, gboolean success, char *buf, size_t size)
+{
+    struct read_ctx *rctx = (struct read_ctx *) ctx;
+
+    rctx->calls++;
+    rctx->success = success;
+    rctx->size = size;
+}
+/*}}}*/
+
+static void fileio_test_setup (gpointer *fixture, gconstpointer test_data)
+{
+    conf_set_uint (app->conf, "s3.part_size", 100);
+    conf_set_uint (app->conf, "s3.upload_parts", 2);
+    conf_set_string (app->conf, "s3.storage_type", "STANDARD");
+
+    cmng = cache_mng_create (app);
+    fake_con = g_new0 (HttpConnection, 1);
+    fake_con->app = app;
+    q_requests = g_queue_new ();
+    fake_fail_path = NULL;
+    fake_last_prio = CLIENT_POOL_PRIO_COUNT;
+}
+
+static void fileio_test_destroy (gpointer *fixture, gconstpointer test_data)
+{
+    g_assert (g_queue_is_empty (q_requests));
+    g_queue_free (q_requests);
+    g_free (fake_con);
+    cache_mng_destroy (cmng);
+}
+
+// writes are acknowledged until the in-flight budget is used up, then they wait for a part to be sent
+static void fileio_test_write_budget (gpointer *fixture, gconstpointer test_data)
+{
+    struct write_ctx wctx = {0, FALSE};
+    FileIO *fop;
+    char buf[100];
+    FakeRequest *part1, *part2;
+
+    memset (buf, 'a', sizeof (buf));
+    fop = fileio_create (app, "file", 1, FALSE);
+
+    fileio_write_buffer (fop, buf, sizeof (buf), 0, 1, write_cb, &wctx);
+    g_assert_cmpint (wctx.calls, ==, 1);
+    g_assert (wctx.success);
+
+    // the second part uses up the budget
+    fileio_write_buffer (fop, buf, sizeof (buf), 100, 1, write_cb, &wctx);
+    g_assert_cmpint (wctx.calls, ==, 1);
+
+    // parts wait for the upload ID
+    app_dispatch (app);
+    fake_reply (fake_pop ("POST", "/file?uploads"), TRUE, UPLOAD_XML, strlen (UPLOAD_XML), NULL);
+    part1 = fake_pop ("PUT", "/file?partNumber=1&uploadId=upload1");
+    part2 = fake_pop ("PUT", "/file?partNumber=2&uploadId=upload1");
+    g_assert_cmpint (wctx.calls, ==, 1);
+
+    fake_reply (part1, TRUE, NULL, 0, NULL);
+    g_assert_cmpint (wctx.calls, ==, 2);
+    g_assert (wctx.success);
+
+    fake_reply (part2, TRUE, NULL, 0, NULL);
+    fileio_release (fop);
+    fake_reply (fake_pop ("POST", "/file?uploadId=upload1"), TRUE, NULL, 0, NULL);
+}
+
+// a failed part fails the delayed writes and all the following ones
+static void fileio_test_write_failed (gpointer *fixture, gconstpointer test_data)
+{
+    struct write_ctx wctx = {0, FALSE};
+    FileIO *fop;
+    char buf[100];
+
+    memset (buf, 'a', sizeof (buf));
+    fop = fileio_create (app, "file", 1, FALSE);
+
+    fileio_write_buffer (fop, buf, sizeof (buf), 0, 1, write_cb, &wctx);
+    fileio_write_buffer (fop, buf, sizeof (buf), 100, 1, write_cb, &wctx);
+    app_dispatch (app);
+    fake_reply (fake_pop ("POST", "/file?uploads"), TRUE, UPLOAD_XML, strlen (UPLOAD_XML), NULL);
+
+    fake_reply (fake_pop ("PUT", "/file?partNumber=1&uploadId=upload1"), FALSE, NULL, 0, NULL);
+    g_assert_cmpint (wctx.calls, ==, 2);
+    g_assert (!wctx.success);
+
+    fileio_write_buffer (fop, buf, 10, 200, 1, write_cb, &wctx);
+    g_assert_cmpint (wctx.calls, ==, 3);
+    g_assert (!wctx.success);
+
+    fake_reply (fake_pop ("PUT", "/file?partNumber=2&uploadId=upload1"), TRUE, NULL, 0, NULL);
+
+    // uploaded parts are removed from the server
+    fileio_release (fop);
+    fake_reply (fake_pop ("DELETE", "/file?uploadId=upload1"), TRUE, NULL, 0, NULL);
+}
+
+// release waits for the parts in flight, then sends the rest of the data and completes the upload
+static void fileio_test_release_pending (gpointer *fixture, gconstpointer test_data)
+{
+    struct write_ctx wctx = {0, FALSE};
+    FileIO *fop;
+    char buf[150];
+    FakeRequest *part1;
+
+    memset (buf, 'a', sizeof (buf));
+    fop = fileio_create (app, "file", 1, FALSE);
+
+    fileio_write_buffer (fop, buf, sizeof (buf), 0, 1, write_cb, &wctx);
+    fileio_write_buffer (fop, buf, 20, 150, 1, write_cb, &wctx);
+    g_assert_cmpint (wctx.calls, ==, 2);
+    app_dispatch (app);
+    fake_reply (fake_pop ("POST", "/file?uploads"), TRUE, UPLOAD_XML, strlen (UPLOAD_XML), NULL);
+    part1 = fake_pop ("PUT", "/file?partNumber=1&uploadId=upload1");
+
+    fileio_release (fop);
+    app_dispatch (app);
+    g_assert (g_queue_is_empty (q_requests));
+
+    // the last part is sent once the first one is done
+    fake_reply (part1, TRUE, NULL, 0, NULL);
+    app_dispatch (app);
+    fake_reply (fake_pop ("PUT", "/file?partNumber=2&uploadId=upload1"), TRUE, NULL, 0, NULL);
+    fake_reply (fake_pop ("POST", "/file?uploadId=upload1"), TRUE, NULL, 0, NULL);
+}
+
+// release of a failed upload aborts it even if parts were still in flight
+static void fileio_test_release_abort (gpointer *fixture, gconstpointer test_data)
+{
+    struct write_ctx wctx = {0, FALSE};
+    FileIO *fop;
+    char buf[100];
+    FakeRequest *part1;
+
+    memset (buf, 'a', sizeof (buf));
+    fop = fileio_create (app, "file", 1, FALSE);
+
+    fileio_write_buffer (fop, buf, sizeof (buf), 0, 1, write_cb, &wctx);
+    app_dispatch (app);
+    fake_reply (fake_pop ("POST", "/file?uploads"), TRUE, UPLOAD_XML, strlen (UPLOAD_XML), NULL);
+    part1 = fake_pop ("PUT", "/file?partNumber=1&uploadId=upload1");
+
+    fileio_release (fop);
+    fake_reply (part1, FALSE, NULL, 0, NULL);
+    fake_reply (fake_pop ("DELETE", "/file?uploadId=upload1"), TRUE, NULL, 0, NULL);
+}
+
+// the upload is aborted if the last part can't be sent
+static void fileio_test_release_last_failed (gpointer *fixture, gconstpointer test_data)
+{
+    struct write_ctx wctx = {0, FALSE};
+    FileIO *fop;
+    char buf[150];
+
+    memset (buf, 'a', sizeof (buf));
+    fop = fileio_create (app, "file", 1, FALSE);
+
+    fileio_write_buffer (fop, buf, sizeof (buf), 0, 1, write_cb, &wctx);
+    app_dispatch (app);
+    fake_reply (fake_pop ("POST", "/file?uploads"), TRUE, UPLOAD_XML, strlen (UPLOAD_XML), NULL);
+    fake_reply (fake_pop ("PUT", "/file?partNumber=1&uploadId=upload1"), TRUE, NULL, 0, NULL);
+
+    fake_fail_path = "/file?partNumber=2&uploadId=upload1";
+    fileio_release (fop);
+    app_dispatch (app);
+    fake_reply (fake_pop ("DELETE", "/file?uploadId=upload1"), TRUE, NULL, 0, NULL);
+}
+
+// reads wait for the prefetch and use its response headers instead of HEAD request
+static void fileio_test_prefetch (gpointer *fixture, gconstpointer test_data)
+{
+    struct read_ctx rctx1 = {0, FALSE, 0};
+    struct read_ctx rctx2 = {0, FALSE, 0};
+    struct evkeyvalq headers;
+    FileIO *fop;
+    FakeRequest *get;
+    char buf[100];
+
+    memset (buf, 'a', sizeof (buf));
+    fop = fileio_create (app, "file", 1, FALSE);
+
+    fileio_prefetch (fop, sizeof (buf));
+    get = fake_pop ("GET", "/file");
+
+    fileio_read_buffer (fop, 10, 0, 1, read_cb, NULL, &rctx1);
+    fileio_read_buffer (fop, 10, 10, 1, read_cb, NULL, &rctx2);
+    g_assert (g_queue_is_empty (q_requests));
+
+    TAILQ_INIT (&headers);
+    evhttp_add_header (&headers, "ETag", "\"etag\"");
+    fake_reply (get, TRUE, buf, sizeof (buf), &headers);
+    evhttp_clear_headers (&headers);
+    app_dispatch (app);
+
+    // served from the cache
+    g_assert (g_queue_is_empty (q_requests));
+    g_assert_cmpint (rctx1.calls, ==, 1);
+    g_assert (rctx1.success);
+    g_assert_cmpint (rctx1.size, ==, 10);
+    g_assert_cmpint (rctx2.calls, ==, 1);
+    g_assert (rctx2.success);
+    g_assert_cmpint (rctx2.size, ==, 10);
+    g_assert_cmpstr (cache_mng_get_etag (cmng, 1), ==, "\"etag\"");
+
+    fileio_destroy (fop);
+}
+
+// reads fall back to a single HEAD request if prefetch fails
+static void fileio_test_prefetch_failed (gpointer *fixture, gconstpointer test_data)
+{
+    struct read_ctx rctx1 = {0, FALSE, 0};
+    struct read_ctx rctx2 = {0, FALSE, 0};
+    FileIO *fop;
+
+    fop = fileio_create (app, "file", 1, FALSE);
+
+    fileio_prefetch (fop, 100);
+    fileio_read_buffer (fop, 10, 0, 1, read_cb, NULL, &rctx1);
+    fileio_read_buffer (fop, 10, 10, 1, read_cb, NULL, &rctx2);
+    fake_reply (fake_pop ("GET", "/file"), FALSE, NULL, 0, NULL);
+
+    fake_reply (fake_pop ("HEAD", "/file"), FALSE, NULL, 0, NULL);
+    g_assert_cmpint (rctx1.calls, ==, 1);
+    g_assert (!rctx1.success);
+    g_assert_cmpint (rctx2.calls, ==, 1);
+    g_assert (!rctx2.success);
+
+    fileio_destroy (fop);
+}
+
+// reads which wait for HEAD request fail if the response has no ETag
+static void fileio_test_head_no_etag (gpointer *fixture, gconstpointer test_data)
+{
+    struct read_ctx rctx1 = {0, FALSE, 0};
+    struct read_ctx rctx2 = {0, FALSE, 0};
+    FileIO *fop;
+
+    fop = fileio_create (app, "file", 1, FALSE);
+
+    fileio_read_buffer (fop, 10, 0, 1, read_cb, NULL, &rctx1);
+    fileio_read_buffer (fop, 10, 10, 1, read_cb, NULL, &rctx2);
+    fake_reply (fake_pop ("HEAD", "/file"), TRUE, NULL, 0, NULL);
+    g_assert (g_queue_is_empty (q_requests));
+    g_assert_cmpint (rctx1.calls, ==, 1);
+    g_assert (!rctx1.success);
+    g_assert_cmpint (rctx2.calls, ==, 1);
+    g_assert (!rctx2.success);
+
+    // headers are requested again
+    fileio_read_buffer (fop, 10, 0, 1, read_cb, NULL, &rctx1);
+    fake_reply (fake_pop ("HEAD", "/file"), FALSE, NULL, 0, NULL);
+    g_assert_cmpint (rctx1.calls, ==, 2);
+
+    fileio_destroy (fop);
+}
+
+// data which is missing in the cache is requested with the priority of reads
+static void fileio_test_read_prio (gpointer *fixture, gconstpointer test_data)
+{
+    struct read_ctx rctx = {0, FALSE, 0};
+    struct evkeyvalq headers;
+    FileIO *fop;
+
+    fop = fileio_create (app, "file", 1, FALSE);
+
+    fileio_read_buffer (fop, 10, 0, 1, read_cb, NULL, &rctx);
+    TAILQ_INIT (&headers);
+    evhttp_add_header (&headers, "ETag", "\"etag\"");
+    evhttp_add_header (&headers, "Content-Length", "100");
+    fake_reply (fake_pop ("HEAD", "/file"), TRUE, NULL, 0, &headers);
+    evhttp_clear_headers (&headers);
+
+    g_assert_cmpint (fake_last_prio, ==, CLIENT_POOL_PRIO_READ);
+    fake_reply (fake_pop ("GET", "/file"), FALSE, NULL, 0, NULL);
+    app_dispatch (app);
+    g_assert (g_queue_is_empty (q_requests));
+    g_assert_cmpint (rctx.calls, ==, 1);
+    g_assert (!rctx.success);
+
+    fileio_destroy (fop);
+}
+
+int main (int argc, char *argv[])
+{
+    app = app_create ();
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add ("/fileio/fileio_test_write_budget", gpointer, 0, fileio_test_setup, fileio_test_write_budget, fileio_test_destroy);
+    g_test_add ("/fileio/fileio_test_write_failed", gpointer, 0, fileio_test_setup, fileio_test_write_failed, fileio_test_destroy);
+    g_test_add ("/fileio/fileio_test_release_pending", gpointer, 0, fileio_test_setup, fileio_test_release_pending, fileio_test_destroy);
+    g_test_add ("/fileio/fileio_test_release_abort", gpointer, 0, fileio_test_setup, fileio_test_release_abort, fileio_test_destroy);
+    g_test_add ("/fileio/fileio_test_release_last_failed", gpointer, 0, fileio_test_setup, fileio_test_release_last_failed, fileio_test_destroy);
+    g_test_add ("/fileio/fileio_test_prefetch", gpointer, 0, fileio_test_setup, fileio_test_prefetch, fileio_test_destroy);
+    g_test_add ("/fileio/fileio_test_prefetch_failed", gpointer, 0, fileio_test_setup, fileio_test_prefetch_failed, fileio_test_destroy);
+    g_test_add ("/fileio/fileio_test_head_no_etag", gpointer, 0, fileio_test_setup, fileio_test_head_no_etag, fileio_test_destroy);
+    g_test_add ("/fileio/fileio_test_read_prio", gpointer, 0, fileio_test_setup, fileio_test_read_prio, fileio_test_destroy);
+
+    return g_test_run ();
+}
@@ -103,6 +103,83 @@ static void range_test_remove_3 (Range **range, gconstpointer test_data)
     g_assert (range_count (*range) == 3);
 }
 
+static void range_test_remove_interval (Range **range, gconstpointer test_data)
+{
+    range_add (*range, 0, 100);
+    range_add (*range, 200, 300);
+
+    // split
+    range_remove (*range, 10, 20);
+    g_assert (range_count (*range) == 3);
+    g_assert (range_length (*range) == 190);
+    g_assert (range_contain (*range, 0, 10) == TRUE);
+    g_assert (range_contain (*range, 5, 15) == FALSE);
+    g_assert (range_contain (*range, 20, 100) == TRUE);
+
+    // trim and remove
+    range_remove (*range, 50, 250);
+    g_assert (range_count (*range) == 3);
+    g_assert (range_length (*range) == 90);
+    g_assert (range_contain (*range, 20, 50) == TRUE);
+    g_assert (range_contain (*range, 250, 300) == TRUE);
+    g_assert (range_contain (*range, 249, 300) == FALSE);
+
+    range_remove (*range, 0, 1000);
+    g_assert (range_count (*range) == 0);
+}
+
+static void range_test_add_missing_cb (guint64 start, guint64 end, gpointer ctx)
+{
+    range_add ((Range *) ctx, start, end);
+}
+
+static void range_test_missing (Range **range, gconstpointer test_data)
+{
+    Range *missing = range_create ();
+
+    range_add (*range, 10, 20);
+    range_add (*range, 30, 40);
+
+    range_foreach_missing (*range, 0, 50, range_test_add_missing_cb, missing);
+    g_assert (range_count (missing) == 3);
+    g_assert (range_length (missing) == 30);
+    g_assert (range_contain (missing, 0, 10) == TRUE);
+    g_assert (range_contain (missing, 20, 30) == TRUE);
+    g_assert (range_contain (missing, 40, 50) == TRUE);
+    range_destroy (missing);
+
+    // fully covered
+    missing = range_create ();
+    range_foreach_missing (*range, 12, 18, range_test_add_missing_cb, missing);
+    g_assert (range_count (missing) == 0);
+    range_destroy (missing);
+
+    // starts inside an interval
+    missing = range_create ();
+    range_foreach_missing (*range, 15, 35, range_test_add_missing_cb, missing);
+    g_assert (range_count (missing) == 1);
+    g_assert (range_contain (missing, 20, 30) == TRUE);
+    range_destroy (missing);
+}
+
+static void range_test_fragmented (Range **range, gconstpointer test_data)
+{
+    guint64 i;
+
+    for (i = 0; i < 10000; i++)
+        range_add (*range, i * 10, i * 10 + 5);
+    g_assert (range_count (*range) == 10000);
+    g_assert (range_length (*range) == 50000);
+    g_assert (range_contain (*range, 50000, 50005) == TRUE);
+    g_assert (range_contain (*range, 50004, 50006) == FALSE);
+
+    // fill the holes
+    for (i = 0; i < 10000; i++)
+        range_add (*range, i * 10 + 5, i * 10 + 10);
+    g_assert (range_count (*range) == 1);
+    g_assert (range_length (*range) == 100000);
+    g_assert (range_contain (*range, 0, 100000) == TRUE);
+}
 
 int main (int argc, char *argv[])
 {
@@ -114,6 +191,9 @@ int main (int argc, char *argv[])
     g_test_add ("/range/range_test_add", Range *, 0, range_test_setup, range_test_remove_1, range_test_destroy);
     g_test_add ("/range/range_test_add", Range *, 0, range_test_setup, range_test_remove_2, range_test_destroy);
     g_test_add ("/range/range_test_add", Range *, 0, range_test_setup, range_test_remove_3, range_test_destroy);
+    g_test_add ("/range/range_test_remove_interval", Range *, 0, range_test_setup, range_test_remove_interval, range_test_destroy);
+    g_test_add ("/range/range_test_missing", Range *, 0, range_test_setup, range_test_missing, range_test_destroy);
+    g_test_add ("/range/range_test_fragmented", Range *, 0, range_test_setup, range_test_fragmented, range_test_destroy);
 
     return g_test_run ();
 }
@@ -16,6 +16,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include "test_application.h"
+#include "worker_pool.h"
 
 struct event_base *application_get_evbase (Application *app)
 {
@@ -37,6 +38,11 @@ ConfData *application_get_conf (Application *app)
     return app->conf;
 }
 
+WorkerPool *application_get_worker_pool (Application *app)
+{
+    return app->worker_pool;
+}
+
 StatSrv *application_get_stat_srv (Application *app)
 {
     return NULL;
@@ -59,10 +65,13 @@ Application *app_create ()
     app->evbase = event_base_new ();
     app->dns_base = NULL;
     app->conf = conf_create ();
+    app->worker_pool = worker_pool_create (app, 2);
 
     conf_set_boolean (app->conf, "filesystem.cache_enabled", TRUE);
     conf_set_string (app->conf, "filesystem.cache_dir", "/tmp/s3ffs");
-    conf_set_string (app->conf, "filesystem.cache_dir_max_size", "1Gb");
+    conf_set_uint (app->conf, "filesystem.cache_dir_max_size", 1024 * 1024 * 1024);
+    // periodic timer would keep the event loop running
+    conf_set_uint (app->conf, "filesystem.cache_check_interval", 0);
 
     return app;
 }
@@ -79,5 +88,6 @@ void app_dispatch(Application *app)
 
 void app_destroy (Application *app)
 {
+    worker_pool_destroy (app->worker_pool);
     g_free (app);
 }
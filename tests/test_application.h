@@ -7,6 +7,7 @@ struct _Application {
     struct event_base *evbase;
     struct evdns_base *dns_base;
     ConfData *conf;
+    WorkerPool *worker_pool;
 
     GList *l_files;
     GHashTable *h_clients_freq; // keeps the number of requests for each HTTP client
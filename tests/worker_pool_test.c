@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2012-2014 Paul Ionkin <paul.ionkin@gmail.com>
+ * Copyright (C) 2012-2014 Skoobe GmbH. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "worker_pool.h"
+#include "test_application.h"
+
+#define TASKS_COUNT 100
+
+struct test_ctx {
+    gint tasks_run; // changed by worker threads
+    gint tasks_done;
+    gint tasks_in_loop; // tasks executed in the event loop thread
+    GThread *loop_thread;
+};
+
+static Application *app;
+
+static void worker_pool_test_setup (WorkerPool **wpool, gconstpointer test_data)
+{
+    *wpool = worker_pool_create (app, 2);
+    g_assert (*wpool);
+}
+
+static void worker_pool_test_destroy (WorkerPool **wpool, gconstpointer test_data)
+{
+    if (*wpool)
+        worker_pool_destroy (*wpool);
+}
+
+static void task_cb (gpointer ctx)
+{
+    struct test_ctx *test_ctx = (struct test_ctx *) ctx;
+
+    if (g_thread_self () == test_ctx->loop_thread)
+        g_atomic_int_inc (&test_ctx->tasks_in_loop);
+    g_atomic_int_inc (&test_ctx->tasks_run);
+}
+
+static void task_done_cb (gpointer ctx)
+{
+    struct test_ctx *test_ctx = (struct test_ctx *) ctx;
+
+    g_assert (g_thread_self () == test_ctx->loop_thread);
+    // the task is finished before its completion callback is called
+    g_assert_cmpint (g_atomic_int_get (&test_ctx->tasks_run), >, test_ctx->tasks_done);
+    test_ctx->tasks_done++;
+}
+
+// tasks run in the worker threads, completion callbacks in the event loop,
+// the loop exits once there is nothing to wait for
+static void worker_pool_test_push (WorkerPool **wpool, gconstpointer test_data)
+{
+    struct test_ctx test_ctx = {0, 0, 0, g_thread_self ()};
+    int i;
+
+    for (i = 0; i < TASKS_COUNT; i++)
+        g_assert (worker_pool_push (*wpool, task_cb, task_done_cb, &test_ctx));
+    app_dispatch (app);
+
+    g_assert_cmpint (test_ctx.tasks_run, ==, TASKS_COUNT);
+    g_assert_cmpint (test_ctx.tasks_done, ==, TASKS_COUNT);
+    g_assert_cmpint (test_ctx.tasks_in_loop, ==, 0);
+
+    // the pool is reusable
+    g_assert (worker_pool_push (*wpool, task_cb, task_done_cb, &test_ctx));
+    app_dispatch (app);
+    g_assert_cmpint (test_ctx.tasks_done, ==, TASKS_COUNT + 1);
+}
+
+// completion callbacks of the finished tasks are called on destroy
+static void worker_pool_test_drain (WorkerPool **wpool, gconstpointer test_data)
+{
+    struct test_ctx test_ctx = {0, 0, 0, g_thread_self ()};
+    int i;
+
+    for (i = 0; i < TASKS_COUNT; i++)
+        g_assert (worker_pool_push (*wpool, task_cb, task_done_cb, &test_ctx));
+
+    worker_pool_destroy (*wpool);
+    *wpool = NULL;
+
+    g_assert_cmpint (test_ctx.tasks_run, ==, TASKS_COUNT);
+    g_assert_cmpint (test_ctx.tasks_done, ==, TASKS_COUNT);
+}
+
+int main (int argc, char *argv[])
+{
+    app = app_create ();
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add ("/worker_pool/worker_pool_test_push", WorkerPool *, 0, worker_pool_test_setup, worker_pool_test_push, worker_pool_test_destroy);
+    g_test_add ("/worker_pool/worker_pool_test_drain", WorkerPool *, 0, worker_pool_test_setup, worker_pool_test_drain, worker_pool_test_destroy);
+
+    return g_test_run ();
+}